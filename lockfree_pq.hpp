@@ -1,261 +1,2599 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <vector>
-#include <mutex>
 #include <functional>
 #include <random>
 #include <limits>
 #include <memory>
+#include <new>
 #include <algorithm>
+#include <type_traits>
+#include <cmath>
+#include <thread>
+#include <utility>
+#include <optional>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace lf {
 
+// -----------------------------------------------------------------------------
+// Intrusive Retire Header
+// -----------------------------------------------------------------------------
+// Objects handed to a reclamation domain derive from Reclaimable. Retiring
+// links the object into a retire list through this header and records a plain
+// function to free it, so the retire path never allocates.
+struct Reclaimable {
+    Reclaimable* retireNext = nullptr;
+    void (*reclaim)(Reclaimable*) = nullptr;
+};
+
+namespace detail {
+
+// Reclaim every object on an intrusive retire list
+inline void reclaimList(Reclaimable* obj) noexcept {
+    while (obj) {
+        Reclaimable* next = obj->retireNext;
+        obj->reclaim(obj);
+        obj = next;
+    }
+}
+
+// Index of the lowest set bit of a non-zero word
+inline unsigned ctz64(std::uint64_t x) noexcept {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+// xorshift64* generator: one 64-bit state, three shifts and a multiply per
+// draw. Meets UniformRandomBitGenerator, so it also feeds std distributions.
+class XorShift64Star {
+public:
+    using result_type = std::uint64_t;
+
+    explicit XorShift64Star(std::uint64_t seed = 0x9e3779b97f4a7c15ull) noexcept {
+        this->seed(seed);
+    }
+
+    // The all-zero state is a fixed point, so it is remapped
+    void seed(std::uint64_t seed) noexcept {
+        state_ = seed ? seed : 0x9e3779b97f4a7c15ull;
+    }
+
+    static constexpr result_type min() noexcept { return 0; }
+    static constexpr result_type max() noexcept { return ~result_type(0); }
+
+    result_type operator()() noexcept {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        return state_ * 0x2545f4914f6cdd1dull;
+    }
+
+private:
+    std::uint64_t state_;
+};
+
+// Seed for one thread's generator: a process-wide random start stepped by
+// the golden-ratio increment per call, then run through the splitmix64
+// finalizer so consecutive threads get unrelated streams
+inline std::uint64_t threadSeed() noexcept {
+    static std::atomic<std::uint64_t> next(std::random_device{}());
+    std::uint64_t z = next.fetch_add(0x9e3779b97f4a7c15ull, std::memory_order_relaxed);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Set of slot indices below N that a guard has written, so releasing the
+// record clears exactly those instead of a whole prefix of slots
+template<size_t N>
+class SlotSet {
+public:
+    SlotSet() {
+        for (size_t i = 0; i < Words; ++i)
+            words_[i] = 0;
+    }
+
+    void insert(size_t idx) noexcept {
+        words_[idx / 64] |= std::uint64_t(1) << (idx % 64);
+    }
+
+    template<typename F>
+    void forEach(F f) const noexcept {
+        for (size_t i = 0; i < Words; ++i) {
+            for (std::uint64_t bits = words_[i]; bits; bits &= bits - 1)
+                f(i * 64 + ctz64(bits));
+        }
+    }
+
+private:
+    static const size_t Words = (N + 63) / 64;
+    std::uint64_t words_[Words];
+};
+
+// -----------------------------------------------------------------------------
+// Registry of Per-Thread Domain Records
+// -----------------------------------------------------------------------------
+// Records are claimed for one operation at a time and live in a grow-only
+// lock-free list, so any number of threads can take part. Each thread retries
+// the record it used last, which in steady state makes a claim one
+// uncontended exchange. Records provide `std::atomic<bool> active` and
+// `Record* next`; the thread-local cache assumes one registry per Record type,
+// which holds because domains are singletons.
+template<typename Record>
+class RecordRegistry {
+public:
+    RecordRegistry() : head_(nullptr), count_(0) {}
+
+    ~RecordRegistry() {
+        Record* rec = head_.load(std::memory_order_relaxed);
+        while (rec) {
+            Record* next = rec->next;
+            delete rec;
+            rec = next;
+        }
+    }
+
+    RecordRegistry(const RecordRegistry&) = delete;
+    RecordRegistry& operator=(const RecordRegistry&) = delete;
+
+    // Claim a free record, appending a new one when all are in use
+    Record* acquire() {
+        Record*& cached = cachedRecord();
+        if (cached && tryClaim(cached))
+            return cached;
+        Record* rec = head_.load(std::memory_order_acquire);
+        while (rec && !tryClaim(rec))
+            rec = rec->next;
+        if (!rec) {
+            rec = new Record();
+            rec->active.store(true, std::memory_order_relaxed);
+            Record* head = head_.load(std::memory_order_relaxed);
+            do {
+                rec->next = head;
+            } while (!head_.compare_exchange_weak(
+                         head, rec,
+                         std::memory_order_release,
+                         std::memory_order_relaxed));
+            count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        cached = rec;
+        return rec;
+    }
+
+    // Hand a claimed record back
+    static void release(Record* rec) noexcept {
+        rec->active.store(false, std::memory_order_release);
+    }
+
+    // First record of the list, for scans
+    Record* first() const noexcept {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    // Number of records ever created
+    size_t size() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Record this thread used last; tried first so threads keep their own
+    static Record*& cachedRecord() noexcept {
+        static thread_local Record* rec = nullptr;
+        return rec;
+    }
+
+    static bool tryClaim(Record* rec) noexcept {
+        return !rec->active.load(std::memory_order_relaxed) &&
+               !rec->active.exchange(true, std::memory_order_acquire);
+    }
+
+    std::atomic<Record*> head_;
+    std::atomic<size_t> count_;
+};
+
+} // namespace detail
+
 // -----------------------------------------------------------------------------
 // Simple Hazard Pointer Domain for Memory Reclamation
 // -----------------------------------------------------------------------------
-class HazardDomain {
-    static const size_t MAX_HAZARD_POINTERS = 128;
-    std::atomic<void*> hp_[MAX_HAZARD_POINTERS];
+// Hazard slots are grouped into records. A thread borrows a record for the
+// duration of one operation through a Guard, so threads never share a slot.
+// Each record also carries the retire list of its holder, so retiring never
+// takes a lock.
+class HazardDomain {
+public:
+    using Header = Reclaimable;
+
+    // Hazard slots owned by one record: enough for a LockFreePQ of 64 levels
+    static const size_t SlotsPerRecord = 136;
+    // Low pointer bits used as tags by callers; ignored when publishing
+    static const std::uintptr_t TagMask = 3;
+    // Every traversed pointer needs its own validated hazard
+    static const bool ProtectsPerPointer = true;
+
+private:
+    struct alignas(64) HazardRecord {
+        std::atomic<void*> hp[SlotsPerRecord];
+        std::atomic<bool> active;
+        HazardRecord* next;
+        // Only touched by the thread holding the record
+        Reclaimable* retired;
+        size_t retiredCount;
+        std::vector<void*> snapshot;
+
+        HazardRecord()
+            : active(false), next(nullptr), retired(nullptr), retiredCount(0)
+        {
+            for (size_t i = 0; i < SlotsPerRecord; ++i)
+                hp[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    detail::RecordRegistry<HazardRecord> records_;
+
+    HazardDomain() = default;
+
+    ~HazardDomain() {
+        for (HazardRecord* rec = records_.first(); rec; rec = rec->next)
+            detail::reclaimList(rec->retired);
+    }
+
+    using Slots = detail::SlotSet<SlotsPerRecord>;
+
+    // Clear the used slots of rec and hand it back. Its retire list stays
+    // with it and is scanned by the next holder.
+    void release(HazardRecord* rec, const Slots& used) noexcept {
+        used.forEach([rec](size_t i) {
+            rec->hp[i].store(nullptr, std::memory_order_release);
+        });
+        records_.release(rec);
+    }
+
+    // Retire list length that triggers a scan: twice the number of hazard
+    // slots, so at least half of every scanned batch is reclaimable
+    size_t scanThreshold() const noexcept {
+        return 2 * SlotsPerRecord * records_.size();
+    }
+
+    // Scan hazard pointers and reclaim the safe-to-delete part of rec's
+    // retire list. The hazards are snapshotted and sorted once, so each
+    // retired object costs a binary search, and survivors are relinked in
+    // the same pass.
+    void scan(HazardRecord* rec) {
+        std::vector<void*>& hazards = rec->snapshot;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        hazards.clear();
+        for (HazardRecord* r = records_.first(); r; r = r->next) {
+            for (size_t i = 0; i < SlotsPerRecord; ++i) {
+                void* p = r->hp[i].load(std::memory_order_seq_cst);
+                if (p) hazards.push_back(p);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end(), std::less<void*>());
+        Reclaimable* kept = nullptr;
+        size_t keptCount = 0;
+        Reclaimable* obj = rec->retired;
+        while (obj) {
+            Reclaimable* next = obj->retireNext;
+            if (std::binary_search(hazards.begin(), hazards.end(),
+                                   static_cast<void*>(obj), std::less<void*>())) {
+                obj->retireNext = kept;
+                kept = obj;
+                ++keptCount;
+            } else {
+                obj->reclaim(obj);
+            }
+            obj = next;
+        }
+        rec->retired = kept;
+        rec->retiredCount = keptCount;
+    }
+
+public:
+    // RAII owner of one hazard record for the duration of an operation
+    class Guard {
+    public:
+        explicit Guard(HazardDomain& domain)
+            : domain_(domain), rec_(domain.records_.acquire()) {}
+
+        ~Guard() { domain_.release(rec_, used_); }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        // Protect the pointer stored in addr in slot idx (retry until stable).
+        // The returned value keeps its tag bits; the hazard does not.
+        template<typename U>
+        U* protect(const std::atomic<U*>& addr, size_t idx) noexcept {
+            touch(idx);
+            U* p = addr.load(std::memory_order_acquire);
+            while (true) {
+                rec_->hp[idx].store(hazardOf(p), std::memory_order_seq_cst);
+                U* q = addr.load(std::memory_order_seq_cst);
+                if (q == p)
+                    return p;
+                p = q;
+            }
+        }
+
+        // Copy the hazard in slot from into slot to. scan() reads slots in
+        // ascending order, so to must be above from for the pointer to stay
+        // visible while from is later overwritten.
+        void copy(size_t to, size_t from) noexcept {
+            touch(to);
+            rec_->hp[to].store(rec_->hp[from].load(std::memory_order_relaxed),
+                               std::memory_order_seq_cst);
+        }
+
+        // Drop the hazard held in slot idx
+        void clear(size_t idx) noexcept {
+            rec_->hp[idx].store(nullptr, std::memory_order_release);
+        }
+
+        // Retire obj into this record's list, to be freed by reclaim once no
+        // hazard covers it; scans the list once it reaches the threshold
+        void retire(Reclaimable* obj, void (*reclaim)(Reclaimable*)) noexcept {
+            obj->reclaim = reclaim;
+            obj->retireNext = rec_->retired;
+            rec_->retired = obj;
+            if (++rec_->retiredCount >= domain_.scanThreshold())
+                domain_.scan(rec_);
+        }
+
+    private:
+        // Address published for p: tag bits dropped and, for retirable
+        // types, converted to the Reclaimable base that scan() compares
+        template<typename U>
+        static void* hazardOf(U* p) noexcept {
+            U* raw = reinterpret_cast<U*>(
+                reinterpret_cast<std::uintptr_t>(p) & ~TagMask);
+            if constexpr (std::is_base_of<Reclaimable, U>::value)
+                return static_cast<Reclaimable*>(raw);
+            else
+                return raw;
+        }
+
+        void touch(size_t idx) noexcept {
+            used_.insert(idx);
+        }
+
+        HazardDomain& domain_;
+        HazardRecord* rec_;
+        Slots used_;
+    };
+
+    // Get singleton instance
+    static HazardDomain* instance() {
+        static HazardDomain inst;
+        return &inst;
+    }
+
+    // Objects need no allocation-time bookkeeping
+    void stamp(Reclaimable*) noexcept {}
+
+    // Retire an object with a reclaim function, recycle when safe
+    void retire(Reclaimable* obj, void (*reclaim)(Reclaimable*)) {
+        Guard guard(*this);
+        guard.retire(obj, reclaim);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Epoch-Based Reclamation Domain
+// -----------------------------------------------------------------------------
+// Classic three-epoch scheme. A Guard pins the current global epoch for the
+// duration of an operation; objects retired while pinned at epoch e are
+// reclaimed once the global epoch reaches e + 2, when no thread can still be
+// inside an operation that saw them. Reads need no per-pointer protection,
+// but a thread that stalls while pinned holds back all reclamation.
+class EpochDomain {
+public:
+    using Header = Reclaimable;
+
+    // Guards protect whole operations, so any slot index is accepted
+    static const size_t SlotsPerRecord = std::numeric_limits<size_t>::max();
+    // Traversals need no per-pointer validation
+    static const bool ProtectsPerPointer = false;
+
+private:
+    static const unsigned Epochs = 3;
+    // Retired objects a record gathers before trying to advance the epoch
+    static const size_t AdvanceThreshold = 64;
+
+    struct alignas(64) EpochRecord {
+        std::atomic<std::uint64_t> epoch;
+        std::atomic<bool> active;
+        EpochRecord* next;
+        // Only touched by the thread holding the record
+        Reclaimable* limbo[Epochs];
+        std::uint64_t limboEpoch[Epochs];
+        size_t retiredCount;
+
+        EpochRecord() : epoch(0), active(false), next(nullptr), retiredCount(0) {
+            for (unsigned i = 0; i < Epochs; ++i) {
+                limbo[i] = nullptr;
+                limboEpoch[i] = 0;
+            }
+        }
+    };
+
+    std::atomic<std::uint64_t> epoch_;
+    detail::RecordRegistry<EpochRecord> records_;
+
+    EpochDomain() : epoch_(0) {}
+
+    ~EpochDomain() {
+        for (EpochRecord* rec = records_.first(); rec; rec = rec->next)
+            for (unsigned i = 0; i < Epochs; ++i)
+                detail::reclaimList(rec->limbo[i]);
+    }
+
+    // Announce the global epoch in a freshly claimed record and free the
+    // limbo lists that are at least two epochs old
+    void pin(EpochRecord* rec) noexcept {
+        std::uint64_t e = epoch_.load(std::memory_order_acquire);
+        rec->epoch.store(e, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (unsigned i = 0; i < Epochs; ++i) {
+            if (rec->limbo[i] && rec->limboEpoch[i] + 2 <= e) {
+                detail::reclaimList(rec->limbo[i]);
+                rec->limbo[i] = nullptr;
+            }
+        }
+    }
+
+    // Move the global epoch forward if every pinned record has seen it
+    void tryAdvance() noexcept {
+        std::uint64_t e = epoch_.load(std::memory_order_seq_cst);
+        for (EpochRecord* r = records_.first(); r; r = r->next) {
+            if (r->active.load(std::memory_order_seq_cst) &&
+                r->epoch.load(std::memory_order_seq_cst) != e)
+                return;
+        }
+        epoch_.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel);
+    }
+
+public:
+    // RAII pin of the current epoch for the duration of an operation
+    class Guard {
+    public:
+        explicit Guard(EpochDomain& domain)
+            : domain_(domain), rec_(domain.records_.acquire())
+        {
+            domain_.pin(rec_);
+        }
+
+        ~Guard() { domain_.records_.release(rec_); }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        // Read a pointer; the pin already keeps its target alive
+        template<typename U>
+        U* protect(const std::atomic<U*>& addr, size_t) noexcept {
+            return addr.load(std::memory_order_acquire);
+        }
+
+        void copy(size_t, size_t) noexcept {}
+        void clear(size_t) noexcept {}
+
+        // Retire obj into the limbo list of the current global epoch, which
+        // is at least the epoch of any thread that could still reach obj
+        void retire(Reclaimable* obj, void (*reclaim)(Reclaimable*)) noexcept {
+            std::uint64_t e = domain_.epoch_.load(std::memory_order_seq_cst);
+            unsigned i = static_cast<unsigned>(e % Epochs);
+            if (rec_->limbo[i] && rec_->limboEpoch[i] != e) {
+                // Left over from three or more epochs ago: already safe
+                detail::reclaimList(rec_->limbo[i]);
+                rec_->limbo[i] = nullptr;
+            }
+            obj->reclaim = reclaim;
+            obj->retireNext = rec_->limbo[i];
+            rec_->limbo[i] = obj;
+            rec_->limboEpoch[i] = e;
+            if (++rec_->retiredCount % AdvanceThreshold == 0)
+                domain_.tryAdvance();
+        }
+
+    private:
+        EpochDomain& domain_;
+        EpochRecord* rec_;
+    };
+
+    // Get singleton instance
+    static EpochDomain* instance() {
+        static EpochDomain inst;
+        return &inst;
+    }
+
+    // Objects need no allocation-time bookkeeping
+    void stamp(Reclaimable*) noexcept {}
+
+    // Retire an object with a reclaim function, recycle when safe
+    void retire(Reclaimable* obj, void (*reclaim)(Reclaimable*)) {
+        Guard guard(*this);
+        guard.retire(obj, reclaim);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Hazard Eras Reclamation Domain
+// -----------------------------------------------------------------------------
+// Hazard eras (Ramalhete & Correia): a global era clock ticks as objects are
+// retired, every object records the era it was born and retired in, and
+// traversals reserve the current era in a slot instead of a pointer. An
+// object is freed once no reserved era falls inside its lifetime. Eras change
+// rarely, so protect() is usually two loads with no store or fence, while a
+// stalled thread only pins the objects alive in the eras it reserved.
+struct EraReclaimable : Reclaimable {
+    std::uint64_t birthEra = 0;
+    std::uint64_t retireEra = 0;
+};
+
+class HazardEraDomain {
+public:
+    using Header = EraReclaimable;
+
+    // Era slots owned by one record: enough for a LockFreePQ of 64 levels
+    static const size_t SlotsPerRecord = 136;
+    // A reservation only holds pointers read under it and still reachable
+    static const bool ProtectsPerPointer = true;
+
+private:
+    // Sentinel for an empty slot; the clock starts above it
+    static const std::uint64_t NoEra = 0;
+    // Retires per record between era increments
+    static const size_t EraFrequency = 16;
+
+    struct alignas(64) EraRecord {
+        std::atomic<std::uint64_t> he[SlotsPerRecord];
+        std::atomic<bool> active;
+        EraRecord* next;
+        // Only touched by the thread holding the record
+        Reclaimable* retired;
+        size_t retiredCount;
+        size_t retiresSinceTick;
+        std::vector<std::uint64_t> snapshot;
+
+        EraRecord()
+            : active(false), next(nullptr), retired(nullptr),
+              retiredCount(0), retiresSinceTick(0)
+        {
+            for (size_t i = 0; i < SlotsPerRecord; ++i)
+                he[i].store(NoEra, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<std::uint64_t> era_;
+    detail::RecordRegistry<EraRecord> records_;
+
+    HazardEraDomain() : era_(NoEra + 1) {}
+
+    ~HazardEraDomain() {
+        for (EraRecord* rec = records_.first(); rec; rec = rec->next)
+            detail::reclaimList(rec->retired);
+    }
+
+    using Slots = detail::SlotSet<SlotsPerRecord>;
+
+    // Clear the used slots of rec and hand it back
+    void release(EraRecord* rec, const Slots& used) noexcept {
+        used.forEach([rec](size_t i) {
+            rec->he[i].store(NoEra, std::memory_order_release);
+        });
+        records_.release(rec);
+    }
+
+    // Same batching rule as HazardDomain: twice the number of era slots
+    size_t scanThreshold() const noexcept {
+        return 2 * SlotsPerRecord * records_.size();
+    }
+
+    // Snapshot and sort the reserved eras, then free every object of rec's
+    // retire list whose [birth, retire] interval holds none of them
+    void scan(EraRecord* rec) {
+        std::vector<std::uint64_t>& eras = rec->snapshot;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        eras.clear();
+        for (EraRecord* r = records_.first(); r; r = r->next) {
+            for (size_t i = 0; i < SlotsPerRecord; ++i) {
+                std::uint64_t e = r->he[i].load(std::memory_order_seq_cst);
+                if (e != NoEra) eras.push_back(e);
+            }
+        }
+        std::sort(eras.begin(), eras.end());
+        Reclaimable* kept = nullptr;
+        size_t keptCount = 0;
+        Reclaimable* obj = rec->retired;
+        while (obj) {
+            Reclaimable* next = obj->retireNext;
+            EraReclaimable* eo = static_cast<EraReclaimable*>(obj);
+            auto it = std::lower_bound(eras.begin(), eras.end(), eo->birthEra);
+            if (it != eras.end() && *it <= eo->retireEra) {
+                obj->retireNext = kept;
+                kept = obj;
+                ++keptCount;
+            } else {
+                obj->reclaim(obj);
+            }
+            obj = next;
+        }
+        rec->retired = kept;
+        rec->retiredCount = keptCount;
+    }
+
+public:
+    // RAII owner of one era record for the duration of an operation
+    class Guard {
+    public:
+        explicit Guard(HazardEraDomain& domain)
+            : domain_(domain), rec_(domain.records_.acquire()) {}
+
+        ~Guard() { domain_.release(rec_, used_); }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        // Read the pointer stored in addr with the current era reserved in
+        // slot idx; only re-publishes when the clock has moved
+        template<typename U>
+        U* protect(const std::atomic<U*>& addr, size_t idx) noexcept {
+            touch(idx);
+            std::uint64_t prev = rec_->he[idx].load(std::memory_order_relaxed);
+            while (true) {
+                U* p = addr.load(std::memory_order_acquire);
+                std::uint64_t e = domain_.era_.load(std::memory_order_acquire);
+                if (e == prev)
+                    return p;
+                rec_->he[idx].store(e, std::memory_order_seq_cst);
+                prev = e;
+            }
+        }
+
+        // Copy the era in slot from into slot to; as in HazardDomain, to must
+        // be above from because scan() reads slots in ascending order
+        void copy(size_t to, size_t from) noexcept {
+            touch(to);
+            rec_->he[to].store(rec_->he[from].load(std::memory_order_relaxed),
+                               std::memory_order_seq_cst);
+        }
+
+        // Drop the era held in slot idx
+        void clear(size_t idx) noexcept {
+            rec_->he[idx].store(NoEra, std::memory_order_release);
+        }
+
+        // Retire obj with the current era as its end of life, ticking the
+        // clock every EraFrequency retires and scanning at the threshold
+        void retire(EraReclaimable* obj, void (*reclaim)(Reclaimable*)) noexcept {
+            obj->retireEra = domain_.era_.load(std::memory_order_seq_cst);
+            obj->reclaim = reclaim;
+            obj->retireNext = rec_->retired;
+            rec_->retired = obj;
+            if (++rec_->retiresSinceTick == EraFrequency) {
+                rec_->retiresSinceTick = 0;
+                domain_.era_.fetch_add(1, std::memory_order_acq_rel);
+            }
+            if (++rec_->retiredCount >= domain_.scanThreshold())
+                domain_.scan(rec_);
+        }
+
+    private:
+        void touch(size_t idx) noexcept {
+            used_.insert(idx);
+        }
+
+        HazardEraDomain& domain_;
+        EraRecord* rec_;
+        Slots used_;
+    };
+
+    // Get singleton instance
+    static HazardEraDomain* instance() {
+        static HazardEraDomain inst;
+        return &inst;
+    }
+
+    // Record the birth era of a freshly allocated object
+    void stamp(EraReclaimable* obj) noexcept {
+        obj->birthEra = era_.load(std::memory_order_acquire);
+    }
+
+    // Retire an object with a reclaim function, recycle when safe
+    void retire(EraReclaimable* obj, void (*reclaim)(Reclaimable*)) {
+        Guard guard(*this);
+        guard.retire(obj, reclaim);
+    }
+};
+
+namespace detail {
+
+// -----------------------------------------------------------------------------
+// Slab Allocator with Per-Thread Caches
+// -----------------------------------------------------------------------------
+// Fixed-size blocks in Classes size classes, where Block::blockSize(cls) gives
+// the size of class cls and Block::blockAlign the alignment of every block. Each thread allocates from and frees into its own
+// cache; caches trade whole batches with a lock-free per-class stack and carve
+// fresh slabs when both are empty. The pool is never destroyed and slab memory
+// is kept for reuse rather than being handed back to malloc. A thread whose
+// cache has already been destroyed (reclamation run from static destructors
+// at exit comes after the main thread's thread_locals are gone) bypasses it
+// and trades single blocks with the shared stack directly.
+template<typename Block, size_t Classes>
+class SlabPool {
+public:
+    // Process-wide pool for Block
+    static SlabPool& instance() {
+        static SlabPool* pool = new SlabPool();
+        return *pool;
+    }
+
+    // Take a block of class cls
+    void* allocate(size_t cls) {
+        if (cacheState() == CacheState::Dead)
+            return allocateShared(cls);
+        ThreadCache& cache = threadCache();
+        if (!cache.head[cls]) {
+            FreeBlock* batch = popBatch(cls);
+            if (batch) {
+                cache.head[cls] = batch;
+                cache.count[cls] = batch->count;
+            } else {
+                carveSlab(cache, cls);
+            }
+        }
+        FreeBlock* b = cache.head[cls];
+        cache.head[cls] = b->next;
+        --cache.count[cls];
+        return b;
+    }
+
+    // Return a block of class cls
+    void deallocate(void* p, size_t cls) noexcept {
+        FreeBlock* b = static_cast<FreeBlock*>(p);
+        if (cacheState() == CacheState::Dead) {
+            b->next = nullptr;
+            b->count = 1;
+            pushBatch(cls, b);
+            return;
+        }
+        ThreadCache& cache = threadCache();
+        b->next = cache.head[cls];
+        cache.head[cls] = b;
+        if (++cache.count[cls] >= 2 * BatchBlocks)
+            spill(cache, cls, BatchBlocks);
+    }
+
+private:
+    // Blocks per batch moved between a thread cache and the shared stack
+    static const size_t BatchBlocks = 64;
+    // Blocks carved from the system allocator at once
+    static const size_t SlabBlocks = 64;
+
+    // Overlay on a free block; nextBatch and count are valid on batch heads
+    struct FreeBlock {
+        FreeBlock* next;
+        FreeBlock* nextBatch;
+        size_t count;
+    };
+
+    // Lifetime of the calling thread's cache
+    enum class CacheState : unsigned char { Unused, Live, Dead };
+
+    struct ThreadCache {
+        FreeBlock* head[Classes];
+        size_t count[Classes];
+
+        ThreadCache() {
+            for (size_t i = 0; i < Classes; ++i) {
+                head[i] = nullptr;
+                count[i] = 0;
+            }
+            cacheState() = CacheState::Live;
+        }
+
+        // Hand everything back when the thread exits
+        ~ThreadCache() {
+            for (size_t i = 0; i < Classes; ++i)
+                if (count[i])
+                    instance().spill(*this, i, count[i]);
+            cacheState() = CacheState::Dead;
+        }
+    };
+
+    std::atomic<FreeBlock*> batches_[Classes];
+
+    SlabPool() {
+        for (size_t i = 0; i < Classes; ++i)
+            batches_[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    static ThreadCache& threadCache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    // Trivially destructible, so it stays readable after the cache is gone
+    static CacheState& cacheState() noexcept {
+        static thread_local CacheState state = CacheState::Unused;
+        return state;
+    }
+
+    // Take one block without a thread cache
+    void* allocateShared(size_t cls) {
+        FreeBlock* batch = popBatch(cls);
+        if (!batch)
+            return ::operator new(stride(cls), std::align_val_t(Block::blockAlign));
+        if (FreeBlock* rest = batch->next) {
+            rest->count = batch->count - 1;
+            pushBatch(cls, rest);
+        }
+        return batch;
+    }
+
+    static size_t stride(size_t cls) noexcept {
+        const size_t align = Block::blockAlign;
+        size_t size = std::max(Block::blockSize(cls), sizeof(FreeBlock));
+        return (size + align - 1) / align * align;
+    }
+
+    // Fill an empty cache from a new slab
+    void carveSlab(ThreadCache& cache, size_t cls) {
+        const size_t step = stride(cls);
+        char* slab = static_cast<char*>(::operator new(
+            step * SlabBlocks, std::align_val_t(Block::blockAlign)));
+        for (size_t i = SlabBlocks; i-- > 0;) {
+            FreeBlock* b = reinterpret_cast<FreeBlock*>(slab + i * step);
+            b->next = cache.head[cls];
+            cache.head[cls] = b;
+        }
+        cache.count[cls] += SlabBlocks;
+    }
+
+    // Move n blocks from the front of the cache to the shared stack
+    void spill(ThreadCache& cache, size_t cls, size_t n) noexcept {
+        FreeBlock* batch = cache.head[cls];
+        FreeBlock* last = batch;
+        for (size_t i = 1; i < n; ++i)
+            last = last->next;
+        cache.head[cls] = last->next;
+        cache.count[cls] -= n;
+        last->next = nullptr;
+        batch->count = n;
+        pushBatch(cls, batch);
+    }
+
+    // Push one batch
+    void pushBatch(size_t cls, FreeBlock* batch) noexcept {
+        FreeBlock* top = batches_[cls].load(std::memory_order_relaxed);
+        do {
+            batch->nextBatch = top;
+        } while (!batches_[cls].compare_exchange_weak(
+                     top, batch,
+                     std::memory_order_release,
+                     std::memory_order_relaxed));
+    }
+
+    // Take one batch. The whole stack is detached with an exchange, which
+    // cannot suffer ABA, and the rest is put back with one CAS while the
+    // stack is still empty. Batches pushed in between are moved onto the
+    // rest first, so a pop costs as many steps as there were concurrent
+    // pushes rather than as there are batches.
+    FreeBlock* popBatch(size_t cls) noexcept {
+        FreeBlock* batch = batches_[cls].exchange(nullptr, std::memory_order_acquire);
+        if (!batch)
+            return nullptr;
+        FreeBlock* rest = batch->nextBatch;
+        FreeBlock* empty = nullptr;
+        while (rest && !batches_[cls].compare_exchange_strong(
+                           empty, rest,
+                           std::memory_order_release,
+                           std::memory_order_relaxed)) {
+            FreeBlock* pushed = batches_[cls].exchange(nullptr, std::memory_order_acquire);
+            while (pushed) {
+                FreeBlock* next = pushed->nextBatch;
+                pushed->nextBatch = rest;
+                rest = pushed;
+                pushed = next;
+            }
+            empty = nullptr;
+        }
+        return batch;
+    }
+};
+
+} // namespace detail
+
+// Element of a key/value queue, LockFreePQ<KeyValue<K, V>>: searches compare
+// keys only, and values are kept out of the nodes' search path
+template<typename K, typename V>
+struct KeyValue {
+    K key;
+    V value;
+};
+
+namespace detail {
+
+struct NoPayload {};
+
+// Split of a queue element into the key that searches compare and a payload
+// that they never read
+template<typename T>
+struct EntryTraits {
+    using Key = T;
+    using Payload = NoPayload;
+    static const bool HasPayload = false;
+};
+
+template<typename K, typename V>
+struct EntryTraits<KeyValue<K, V>> {
+    using Key = K;
+    using Payload = V;
+    static const bool HasPayload = true;
+};
+
+// Holds a comparator; an empty, non-final one takes no space as a base
+template<typename Compare,
+         bool = std::is_empty<Compare>::value && !std::is_final<Compare>::value>
+class CompareHolder : private Compare {
+public:
+    explicit CompareHolder(const Compare& compare) : Compare(compare) {}
+
+    const Compare& compare() const noexcept {
+        return *this;
+    }
+};
+
+template<typename Compare>
+class CompareHolder<Compare, false> {
+public:
+    explicit CompareHolder(const Compare& compare) : compare_(compare) {}
+
+    const Compare& compare() const noexcept {
+        return compare_;
+    }
+
+private:
+    Compare compare_;
+};
+
+} // namespace detail
+
+// -----------------------------------------------------------------------------
+// Lock-Free Concurrent Min-Priority Queue
+// -----------------------------------------------------------------------------
+// Pops return the smallest key under Compare, so std::greater gives a
+// max-queue; only Compare is needed on keys, not operator== or operator<.
+// Equal keys pop in the order their pushes linked them (FIFO).
+// Reclaimer selects the memory reclamation scheme: HazardDomain (bounded
+// garbage, a validated hazard per traversed node), EpochDomain (plain loads
+// on traversal, reclamation waits for every pinned thread) or HazardEraDomain
+// (bounded garbage, a hazard store only when the era clock moves).
+// LevelCap bounds the tower height: 32 levels keep searches O(log n) up to
+// billions of items, and searches only start at the highest level in use.
+// A node reaches each next level with probability 1/2^LevelShift; a shift of
+// 2 gives shorter towers and fewer CASes per push for longer level walks.
+// For T = KeyValue<K, V> (see KeyValuePQ) nodes hold the key inline and the
+// value after their tower, pushes take the key and the value's constructor
+// arguments, and pops move values out.
+template<typename T, typename Reclaimer = HazardDomain,
+         typename Compare = std::less<typename detail::EntryTraits<T>::Key>,
+         int LevelCap = 32, int LevelShift = 1>
+class LockFreePQ : private detail::CompareHolder<Compare> {
+private:
+    static_assert(LevelCap >= 2 && LevelCap <= 64, "LevelCap must be in 2..64");
+    static_assert(LevelShift >= 1 && LevelShift <= 8, "LevelShift must be in 1..8");
+
+    // Maximum levels for skiplist
+    static constexpr int MaxLevel = LevelCap - 1;
+    static constexpr double Probability = 1.0 / (1 << LevelShift);
+
+    using Key = typename detail::EntryTraits<T>::Key;
+    using Payload = typename detail::EntryTraits<T>::Payload;
+    static const bool HasPayload = detail::EntryTraits<T>::HasPayload;
+
+    // Pops copy keys out (see take), so a move-only element has to be the
+    // payload of a KeyValuePQ
+    static_assert(std::is_copy_constructible<Key>::value && std::is_copy_assignable<Key>::value,
+                  "LockFreePQ keys must be copyable; use KeyValuePQ for move-only payloads");
+
+    // Hazard slot layout: a sliding window of three traversal slots, then a
+    // pinned pred/succ pair per level with the top level first, so pinning a
+    // node on the way down always copies it into a higher slot.
+    static const size_t WindowSlots = 3;
+    static_assert(WindowSlots + 2 * (MaxLevel + 1) <= Reclaimer::SlotsPerRecord,
+                  "Reclaimer records are too small for MaxLevel");
+
+    static size_t predSlot(int level) noexcept {
+        return WindowSlots + 2 * static_cast<size_t>(MaxLevel - level);
+    }
+    static size_t succSlot(int level) noexcept { return predSlot(level) + 1; }
+
+    using Guard = typename Reclaimer::Guard;
+
+    // Variable-height node: the tower is allocated in place after the node
+    // and holds exactly topLevel + 1 links, so the key and next[0] share
+    // the node's first cache line and level-0 nodes carry a single link.
+    // A payload goes after the tower, off the search path. Nodes are only
+    // created through allocNode, which sizes the block. The deletion mark is
+    // the frozen bit of next[0] (see FrozenBit). The key and payload are
+    // constructed in place and sentinels leave them unconstructed, so
+    // neither needs a default constructor.
+    struct Node : Reclaimer::Header {
+        int topLevel;
+        std::atomic<bool> fullyLinked;
+        // Levels this node has been unlinked from; see unlinked()
+        std::atomic<int> unlinkedLevels;
+        alignas(Key) unsigned char storage[sizeof(Key)];
+        std::atomic<Node*> next[1];
+
+        // Sentinel constructor
+        explicit Node(int level)
+            : topLevel(level), fullyLinked(false), unlinkedLevels(0)
+        {
+            initTower();
+        }
+
+        // Value node constructor: the key from the first argument and the
+        // payload, if any, from the rest; a plain T from all of them
+        template<typename... Args>
+        Node(int level, std::in_place_t, Args&&... args)
+            : topLevel(level), fullyLinked(false), unlinkedLevels(0)
+        {
+            initTower();
+            if constexpr (HasPayload)
+                construct(std::forward<Args>(args)...);
+            else
+                new (storage) Key(std::forward<Args>(args)...);
+        }
+
+        Key& key() noexcept {
+            return *std::launder(reinterpret_cast<Key*>(storage));
+        }
+        const Key& key() const noexcept {
+            return *std::launder(reinterpret_cast<const Key*>(storage));
+        }
+
+        Payload& payload() noexcept {
+            return *std::launder(reinterpret_cast<Payload*>(
+                reinterpret_cast<unsigned char*>(this) + payloadOffset(topLevel)));
+        }
+
+        // Block size for a node whose tower ends at level
+        static size_t sizeFor(int level) noexcept {
+            if (HasPayload)
+                return payloadOffset(level) + sizeof(Payload);
+            return towerEnd(level);
+        }
+
+        // Destroy the key and payload of a value node
+        void destroy() noexcept {
+            if constexpr (HasPayload)
+                payload().~Payload();
+            key().~Key();
+        }
+
+    private:
+        static size_t towerEnd(int level) noexcept {
+            return sizeof(Node) + static_cast<size_t>(level) * sizeof(std::atomic<Node*>);
+        }
+
+        static size_t payloadOffset(int level) noexcept {
+            return (towerEnd(level) + alignof(Payload) - 1) & ~(alignof(Payload) - 1);
+        }
+
+        template<typename K, typename... Args>
+        void construct(K&& key, Args&&... args) {
+            new (storage) Key(std::forward<K>(key));
+            new (reinterpret_cast<unsigned char*>(this) + payloadOffset(topLevel))
+                Payload(std::forward<Args>(args)...);
+        }
+
+        void initTower() noexcept {
+            for (int i = 0; i <= topLevel; ++i)
+                new (&next[i]) std::atomic<Node*>(nullptr);
+        }
+    };
+
+    // Nodes come from a slab pool with one size class per tower height.
+    // Blocks start on a cache line, so a node never straddles one more line
+    // than its size requires and the header, value and next[0] of small
+    // nodes are always fetched together.
+    struct NodeBlock {
+        static const size_t blockAlign =
+            std::max<size_t>(64, std::max(alignof(Node), alignof(Payload)));
+        static size_t blockSize(size_t cls) noexcept {
+            return Node::sizeFor(static_cast<int>(cls));
+        }
+    };
+    using Pool = detail::SlabPool<NodeBlock, MaxLevel + 1>;
+
+    template<typename... Args>
+    static Node* allocNode(int level, Args&&... args) {
+        void* mem = Pool::instance().allocate(static_cast<size_t>(level));
+        return new (mem) Node(level, std::forward<Args>(args)...);
+    }
+
+    static void freeSentinel(Node* node) noexcept {
+        size_t cls = static_cast<size_t>(node->topLevel);
+        node->~Node();
+        Pool::instance().deallocate(node, cls);
+    }
+
+    static void freeNode(Node* node) noexcept {
+        node->destroy();
+        freeSentinel(node);
+    }
+
+    static void reclaimNode(Reclaimable* r) {
+        freeNode(static_cast<Node*>(r));
+    }
+
+    // Head and tail sentinels
+    Node* head_;
+    Node* tail_;
+    std::atomic<size_t> count_;
+    Reclaimer* domain_;
+    // Marked prefix length at which a pop sweeps the head
+    size_t boundOffset_;
+    // Highest level any node has been linked on; raised before linking
+    std::atomic<int> level_;
+    // Level-0 CAS retries in push, each of which used to reallocate the node
+    std::atomic<size_t> allocationsAvoided_;
+
+    // Random number generator for levels, seeded by each thread on first use
+    static thread_local detail::XorShift64Star rng_;
+
+    // Generate random level from one draw: each run of LevelShift trailing
+    // zero bits is one more level. The top bit bounds the scan for a zero draw.
+    int randomLevel() {
+        std::uint64_t bits = rng_() | (std::uint64_t(1) << 63);
+        return std::min(static_cast<int>(detail::ctz64(bits)) / LevelShift, MaxLevel);
+    }
+
+    // Low bit of a next pointer: the owning node is being unlinked on that
+    // level, so the link is frozen and can neither be snipped past nor
+    // inserted after by a stale CAS. Freezing next[0] is what logically
+    // deletes a node, so on level 0 the bit doubles as the deletion mark.
+    static const std::uintptr_t FrozenBit = 1;
+
+    static bool isFrozen(Node* p) noexcept {
+        return reinterpret_cast<std::uintptr_t>(p) & FrozenBit;
+    }
+
+    static Node* unfrozen(Node* p) noexcept {
+        return reinterpret_cast<Node*>(
+            reinterpret_cast<std::uintptr_t>(p) & ~FrozenBit);
+    }
+
+    // Set the frozen bit of a link (std::atomic<T*> has no fetch_or)
+    static void freeze(std::atomic<Node*>& link) noexcept {
+        Node* p = link.load(std::memory_order_acquire);
+        while (!isFrozen(p) &&
+               !link.compare_exchange_weak(
+                   p, reinterpret_cast<Node*>(
+                          reinterpret_cast<std::uintptr_t>(p) | FrozenBit),
+                   std::memory_order_acq_rel,
+                   std::memory_order_acquire)) {
+        }
+    }
+
+    // Logically delete node by freezing its level-0 link. Returns false if
+    // another thread marked it first.
+    static bool mark(Node* node) noexcept {
+        Node* p = node->next[0].load(std::memory_order_acquire);
+        while (!isFrozen(p)) {
+            if (node->next[0].compare_exchange_weak(
+                    p, reinterpret_cast<Node*>(
+                           reinterpret_cast<std::uintptr_t>(p) | FrozenBit),
+                    std::memory_order_acq_rel,
+                    std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    static bool isMarked(const Node* node) noexcept {
+        return isFrozen(node->next[0].load(std::memory_order_acquire));
+    }
+
+    // Account for node having been unlinked from one more level. Whoever
+    // removes its last link retires it, so no single thread has to unlink a
+    // node on every level itself. The height is read first: once this
+    // thread has counted, another may count last and free the node.
+    void unlinked(Node* node, Guard& guard) noexcept {
+        const int topLevel = node->topLevel;
+        if (node->unlinkedLevels.fetch_add(1, std::memory_order_acq_rel) == topLevel)
+            guard.retire(node, &reclaimNode);
+    }
+
+    // Hand the element of a node this thread has marked to out. Searches
+    // that passed the node before the mark may still be comparing against
+    // its key, so the key is copied. Payloads are never compared and are
+    // moved out.
+    static void take(Node* node, T& out) {
+        if constexpr (HasPayload) {
+            out.key = node->key();
+            out.value = std::move(node->payload());
+        } else {
+            out = node->key();
+        }
+    }
+
+    // Key of an element
+    static const Key& keyOf(const T& item) noexcept {
+        if constexpr (HasPayload)
+            return item.key;
+        else
+            return item;
+    }
+
+    // Allocate a node for item, moving from it if it is an rvalue
+    template<typename U>
+    Node* createFrom(U&& item) {
+        if constexpr (HasPayload)
+            return createNode(std::forward<U>(item).key, std::forward<U>(item).value);
+        else
+            return createNode(std::forward<U>(item));
+    }
+
+    // Advance pred/curr along one level while before(curr) holds for the
+    // live node curr. pred is protected by slot ps and curr by window slot
+    // cs. Marked nodes behind a live pred are unlinked on the way; the
+    // marked prefix behind the head is stepped over and left to sweepLevel
+    // (Lindén-Jonsson), so searches do not contend on the head's links. A
+    // walk that stops with pred at the head returns the start of that
+    // prefix as curr, since that is what the head links to and a new node
+    // goes in front of it. The prefix nodes stepped over are added to
+    // skipped. Returns false if pred stopped pointing where it did and the
+    // search must restart.
+    template<typename Before>
+    bool walkLevel(Before before, int level, Guard& guard,
+                   Node*& pred, size_t& ps, Node*& curr, size_t& cs,
+                   size_t& skipped) {
+        // What pred links to, protected by slot ls: curr, or while pred is
+        // the head, the first node of the marked prefix curr lies behind
+        Node* link = curr;
+        size_t ls = cs;
+        size_t ss = (cs + 1) % WindowSlots;
+        if (ss == ps) ss = (ss + 1) % WindowSlots;
+        while (curr != tail_) {
+            // Level 0 of a marked node is frozen already
+            if (level > 0 && isMarked(curr))
+                freeze(curr->next[level]);
+            Node* succ = guard.protect(curr->next[level], ss);
+            // An unchanged, unfrozen pred link keeps curr, and so succ,
+            // alive; so does an unchanged head link for the frozen prefix
+            // behind it (see sweepLevel)
+            if (Reclaimer::ProtectsPerPointer &&
+                pred->next[level].load(std::memory_order_acquire) != link)
+                return false;
+            if (isFrozen(succ)) {
+                if (pred == head_) {
+                    curr = unfrozen(succ);
+                    cs = ss;
+                    ss = WindowSlots - ls - cs;
+                    ++skipped;
+                    continue;
+                }
+                Node* expected = curr;
+                if (!pred->next[level].compare_exchange_strong(
+                        expected, unfrozen(succ),
+                        std::memory_order_acq_rel))
+                    return false;
+                unlinked(curr, guard);
+                curr = unfrozen(succ);
+                std::swap(cs, ss);
+                link = curr;
+                ls = cs;
+                continue;
+            }
+            if (!before(curr))
+                break;
+            pred = curr;
+            ps = cs;
+            curr = succ;
+            cs = ss;
+            link = curr;
+            ls = cs;
+            ss = WindowSlots - ps - cs;
+        }
+        curr = link;
+        cs = ls;
+        return true;
+    }
+
+    // Highest level with a node on it, to start descents at: level_ less
+    // the levels whose head link has emptied since
+    int startLevel() const noexcept {
+        int level = level_.load(std::memory_order_acquire);
+        while (level > 0 && head_->next[level].load(std::memory_order_relaxed) == tail_)
+            --level;
+        return level;
+    }
+
+    // Raise level_ to cover a node of the given height before linking it
+    void raiseLevel(int level) noexcept {
+        int seen = level_.load(std::memory_order_relaxed);
+        while (seen < level &&
+               !level_.compare_exchange_weak(seen, level,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+        }
+    }
+
+    bool less(const Key& a, const Key& b) const {
+        return this->compare()(a, b);
+    }
+
+    // Find preds and succs for a given key, keeping every returned node
+    // hazard-protected until the next search through the same guard. Levels
+    // above the start of the descent were empty and get the sentinels. Each
+    // succ is the first node ordering after key, so a new node goes behind
+    // its equals and equal keys pop in FIFO order. A new node in front of
+    // the marked prefix would hide it from pops, which only count what they
+    // skip behind the head, so a search that steps over boundOffset of it
+    // on level 0 sweeps the head and searches again.
+    void findNode(const Key& key, Node* preds[], Node* succs[], Guard& guard) {
+        bool swept = false;
+    retry:
+        int top = startLevel();
+        for (int level = MaxLevel; level > top; --level) {
+            preds[level] = head_;
+            succs[level] = tail_;
+        }
+        Node* pred = head_;
+        size_t ps = predSlot(top);
+        auto before = [this, &key](const Node* n) { return !less(key, n->key()); };
+        for (int level = top; level >= 0; --level) {
+            size_t cs = 0;
+            size_t skipped = 0;
+            Node* curr = guard.protect(pred->next[level], cs);
+            if (isFrozen(curr))
+                goto retry;
+            if (!walkLevel(before, level, guard, pred, ps, curr, cs, skipped))
+                goto retry;
+            if (level == 0 && skipped >= boundOffset_ && !swept) {
+                sweepHead(guard);
+                swept = true;
+                goto retry;
+            }
+            if (ps < WindowSlots) {
+                guard.copy(predSlot(level), ps);
+                ps = predSlot(level);
+            }
+            guard.copy(succSlot(level), cs);
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+    }
+
+    // Search for key again after a search for a key not above it filled
+    // preds and succs (a finger), and levels up to stale may have changed
+    // since. Levels whose old successor still orders after key are
+    // kept; the levels below resume from the old preds, so clustered keys
+    // cost a few hops per level instead of a descent from the head. Falls
+    // back to a full search if a finger node has been unlinked meanwhile.
+    void findNodeFrom(const Key& key, Node* preds[], Node* succs[], Guard& guard,
+                      int stale) {
+        auto before = [this, &key](const Node* n) { return !less(key, n->key()); };
+        int top = stale + 1;
+        while (top <= MaxLevel && succs[top] != tail_ && before(succs[top]))
+            ++top;
+        Node* above = nullptr;
+        for (int level = top - 1; level >= 0; --level) {
+            // Start from whichever of the old pred and the pred just found
+            // on the level above is further along
+            Node* pred = preds[level];
+            size_t ps = predSlot(level);
+            if (above && above != head_ && (pred == head_ || less(pred->key(), above->key()))) {
+                pred = above;
+                ps = predSlot(level + 1);
+            }
+            size_t cs = 0;
+            size_t skipped = 0;
+            Node* curr = guard.protect(pred->next[level], cs);
+            if (isFrozen(curr) ||
+                !walkLevel(before, level, guard, pred, ps, curr, cs, skipped)) {
+                findNode(key, preds, succs, guard);
+                return;
+            }
+            // Keep every pred in its own level's slot, as the next finger
+            // search resumes from it
+            if (ps != predSlot(level))
+                guard.copy(predSlot(level), ps);
+            guard.copy(succSlot(level), cs);
+            preds[level] = pred;
+            succs[level] = curr;
+            above = pred;
+        }
+    }
+
+    // Allocate an unlinked node of random height and construct its element
+    template<typename... Args>
+    Node* createNode(Args&&... args) {
+        int topLevel = randomLevel();
+        raiseLevel(topLevel);
+        Node* node = allocNode(topLevel, std::in_place, std::forward<Args>(args)...);
+        domain_->stamp(node);
+        return node;
+    }
+
+    // Search for the key of a new node and link it
+    void pushNode(Node* node) {
+        Guard guard(*domain_);
+        Node* preds[MaxLevel + 1];
+        Node* succs[MaxLevel + 1];
+        findNode(node->key(), preds, succs, guard);
+        insert(node, preds, succs, guard);
+    }
+
+    // Link newNode between preds and succs, which a search for its key
+    // has filled; searches again whenever a link CAS fails. Returns the
+    // node's top level: succs up to it now lie behind the new node.
+    int insert(Node* newNode, Node* preds[], Node* succs[], Guard& guard) {
+        // Not poppable before it is fully linked, so the key stays put
+        const Key& item = newNode->key();
+        int topLevel = newNode->topLevel;
+        while (true) {
+            for (int lvl = 0; lvl <= topLevel; ++lvl)
+                newNode->next[lvl].store(succs[lvl], std::memory_order_relaxed);
+            Node* succ = succs[0];
+            if (preds[0]->next[0].compare_exchange_strong(
+                    succ, newNode,
+                    std::memory_order_acq_rel))
+                break;
+            // Still private: keep the node and just re-point its links
+            allocationsAvoided_.fetch_add(1, std::memory_order_relaxed);
+            findNode(item, preds, succs, guard);
+        }
+        // newNode cannot be popped before it is fully linked, so it
+        // needs no hazard of its own while the upper levels go in
+        for (int lvl = 1; lvl <= topLevel; ++lvl) {
+            while (true) {
+                newNode->next[lvl].store(succs[lvl], std::memory_order_release);
+                Node* expected = succs[lvl];
+                if (preds[lvl]->next[lvl].compare_exchange_strong(
+                        expected, newNode,
+                        std::memory_order_acq_rel))
+                    break;
+                findNode(item, preds, succs, guard);
+            }
+        }
+        newNode->fullyLinked.store(true, std::memory_order_release);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        return topLevel;
+    }
+
+    // Unlink the run of marked nodes at the front of one level with a single
+    // CAS on the head (Lindén-Jonsson). Each node of the run is frozen on
+    // the level first, so the run cannot change once the CAS has read it.
+    void sweepLevel(int level, Guard& guard) {
+        Node* first = guard.protect(head_->next[level], 0);
+        Node* curr = first;
+        size_t cs = 0;
+        while (curr != tail_ && isMarked(curr)) {
+            freeze(curr->next[level]);
+            size_t ns = (cs == 1) ? 2 : 1;
+            Node* next = unfrozen(guard.protect(curr->next[level], ns));
+            // A frozen link can only be snipped once its owner is, so the
+            // whole run stays alive while the head still points at first
+            if (Reclaimer::ProtectsPerPointer &&
+                head_->next[level].load(std::memory_order_acquire) != first)
+                return;
+            curr = next;
+            cs = ns;
+        }
+        if (curr == first)
+            return;
+        Node* expected = first;
+        if (!head_->next[level].compare_exchange_strong(
+                expected, curr, std::memory_order_acq_rel))
+            return;
+        // The run is ours to account for on this level. Read each link
+        // before counting, as the count may retire the node.
+        for (Node* node = first; node != curr;) {
+            Node* next = unfrozen(node->next[level].load(std::memory_order_acquire));
+            unlinked(node, guard);
+            node = next;
+        }
+    }
+
+    // Advance curr, protected in slot cs, past the frozen run of level 0 that
+    // the head reached through first, counting the nodes skipped. Returns
+    // false if the head moved away from first and the walk must restart.
+    bool skipMarked(Node* first, Node*& curr, size_t& cs, size_t& skipped,
+                    Guard& guard) {
+        while (curr != tail_) {
+            size_t ns = (cs == 1) ? 2 : 1;
+            Node* next = guard.protect(curr->next[0], ns);
+            // As in sweepLevel: the head still pointing at first keeps
+            // every node of the frozen run behind it alive
+            if (Reclaimer::ProtectsPerPointer &&
+                head_->next[0].load(std::memory_order_acquire) != first)
+                return false;
+            if (!isFrozen(next))
+                break;
+            curr = unfrozen(next);
+            cs = ns;
+            ++skipped;
+        }
+        return true;
+    }
+
+    // Batched physical deletion: unlink the marked prefix on every level
+    void sweepHead(Guard& guard) {
+        for (int level = level_.load(std::memory_order_acquire); level >= 0; --level)
+            sweepLevel(level, guard);
+    }
+
+public:
+    // Parameters of pop_relaxed, after the SprayList of Alistarh et al. A
+    // spray starts height levels up at the head and, on every level it
+    // visits, skips a uniform 0..jump live nodes before dropping descent
+    // levels. The node it reaches on level 0 is the one popped.
+    struct Spray {
+        int height;
+        size_t jump;
+        int descent;
+
+        Spray(int h, size_t j, int d)
+            : height(std::clamp(h, 0, MaxLevel)), jump(j), descent(std::max(d, 1)) {}
+
+        // Tuning for p concurrent consumers: height log p + 1, jump
+        // log^3 p, descent max(1, log log p)
+        explicit Spray(size_t consumers) {
+            int logP = 0;
+            while ((size_t(2) << logP) <= consumers) ++logP;
+            int logLogP = 0;
+            while ((2 << logLogP) <= logP) ++logLogP;
+            height = std::min(logP + 1, MaxLevel);
+            jump = static_cast<size_t>(logP) * logP * logP;
+            descent = std::max(logLogP, 1);
+        }
+
+        // Expected rank of the worst node a spray can reach: on each visited
+        // level, jump hops of 1/Probability^level level-0 nodes apiece
+        size_t rankBound() const noexcept {
+            double bound = 0;
+            for (int level = height; ; level = std::max(level - descent, 0)) {
+                bound += static_cast<double>(jump) * std::pow(1 / Probability, level);
+                if (level == 0) break;
+            }
+            return static_cast<size_t>(bound);
+        }
+    };
+
+private:
+    // Sprays that may lose their race before pop_relaxed falls back to pop
+    static const int SprayAttempts = 3;
+
+    // Run one spray. Returns the live node it lands on, protected by guard,
+    // tail_ if it ran off the end, or nullptr if it must be retried. A spray
+    // that never leaves the head lands past the marked prefix, like pop, and
+    // adds the prefix nodes it steps over to skipped.
+    Node* sprayWalk(const Spray& spray, Guard& guard, size_t& skipped) {
+        Node* pred = head_;
+        size_t ps = predSlot(MaxLevel);
+        std::uniform_int_distribution<size_t> jumps(0, spray.jump);
+        for (int level = spray.height; ; level = std::max(level - spray.descent, 0)) {
+            size_t cs = 0;
+            size_t stepped = 0;
+            Node* curr = guard.protect(pred->next[level], cs);
+            if (isFrozen(curr))
+                return nullptr;
+            size_t steps = jumps(rng_);
+            auto before = [&steps](const Node*) {
+                if (steps == 0) return false;
+                --steps;
+                return true;
+            };
+            if (!walkLevel(before, level, guard, pred, ps, curr, cs, stepped))
+                return nullptr;
+            if (level == 0) {
+                if (pred == head_ && !skipMarked(curr, curr, cs, skipped, guard))
+                    return nullptr;
+                return curr;
+            }
+            if (ps < WindowSlots) {
+                guard.copy(predSlot(level), ps);
+                ps = predSlot(level);
+            }
+        }
+    }
+
+public:
+    // Default marked prefix length that triggers a head sweep
+    static const size_t DefaultBoundOffset = 32;
+
+    // Construct priority queue. Pops only mark nodes; once a pop has to skip
+    // boundOffset marked nodes, it unlinks the whole marked prefix at once.
+    LockFreePQ(Reclaimer* domain = nullptr,
+               size_t boundOffset = DefaultBoundOffset,
+               const Compare& compare = Compare())
+        : detail::CompareHolder<Compare>(compare), count_(0),
+          boundOffset_(boundOffset), level_(0), allocationsAvoided_(0)
+    {
+        domain_ = domain ? domain : Reclaimer::instance();
+        head_ = allocNode(MaxLevel);
+        tail_ = allocNode(MaxLevel);
+        for (int i = 0; i <= MaxLevel; ++i)
+            head_->next[i].store(tail_, std::memory_order_relaxed);
+    }
+
+    ~LockFreePQ() {
+        // Drop the upper links of marked nodes; a marked node that is no
+        // longer on level 0 is freed when its last link goes
+        for (int level = MaxLevel; level > 0; --level) {
+            Node* pred = head_;
+            Node* curr = unfrozen(pred->next[level].load(std::memory_order_relaxed));
+            while (curr != tail_) {
+                Node* next = unfrozen(curr->next[level].load(std::memory_order_relaxed));
+                if (isMarked(curr)) {
+                    pred->next[level].store(next, std::memory_order_relaxed);
+                    if (curr->unlinkedLevels.fetch_add(1, std::memory_order_relaxed) ==
+                        curr->topLevel)
+                        freeNode(curr);
+                } else {
+                    pred = curr;
+                }
+                curr = next;
+            }
+        }
+        // Delete all nodes left on level 0
+        Node* node = unfrozen(head_->next[0].load(std::memory_order_relaxed));
+        while (node != tail_) {
+            Node* next = unfrozen(node->next[0].load(std::memory_order_relaxed));
+            freeNode(node);
+            node = next;
+        }
+        freeSentinel(head_);
+        freeSentinel(tail_);
+    }
+
+    // Disable copy
+    LockFreePQ(const LockFreePQ&) = delete;
+    LockFreePQ& operator=(const LockFreePQ&) = delete;
+
+    // Push an item (multiple producers)
+    void push(const T& item) noexcept {
+        pushNode(createFrom(item));
+    }
+
+    void push(T&& item) noexcept {
+        pushNode(createFrom(std::move(item)));
+    }
+
+    // Push an item constructed in place from args (multiple producers). For
+    // a key/value queue, args are the key and the value's constructor
+    // arguments.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        pushNode(createNode(std::forward<Args>(args)...));
+    }
+
+    // Insertion finger for one producer thread with temporally local keys,
+    // such as mostly increasing timestamps. It remembers where its last
+    // push went, and a push whose key is not below the previous one resumes
+    // from there (see findNodeFrom), costing O(log d) for a distance d from
+    // the previous key instead of a descent from the head.
+    //
+    // The remembered nodes stay protected because the finger holds a guard
+    // for its whole lifetime. Under EpochDomain that keeps the thread pinned,
+    // so scope a finger to a burst of pushes rather than a thread's life.
+    class Finger {
+    public:
+        explicit Finger(LockFreePQ& pq)
+            : pq_(pq), guard_(*pq.domain_), stale_(MaxLevel) {}
+
+        Finger(const Finger&) = delete;
+        Finger& operator=(const Finger&) = delete;
+
+        void push(const T& item) {
+            const Key& key = keyOf(item);
+            Node* node = pq_.createFrom(item);
+            if (last_ && !pq_.less(key, *last_))
+                pq_.findNodeFrom(key, preds_, succs_, guard_, stale_);
+            else
+                pq_.findNode(key, preds_, succs_, guard_);
+            stale_ = pq_.insert(node, preds_, succs_, guard_);
+            last_ = key;
+        }
+
+    private:
+        LockFreePQ& pq_;
+        Guard guard_;
+        Node* preds_[MaxLevel + 1];
+        Node* succs_[MaxLevel + 1];
+        std::optional<Key> last_;
+        int stale_;
+    };
+
+    // Finger for the calling thread; see Finger
+    Finger finger() {
+        return Finger(*this);
+    }
+
+    // Push a batch (multiple producers). The batch is sorted first (stably,
+    // so equal keys keep their order), and each item is searched for from
+    // the previous item's position rather than from the head: one descent
+    // plus local hops for clustered keys. Values are constructed from *it
+    // straight into their nodes, so a range of std::move_iterator moves
+    // them in.
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last) {
+        std::vector<Node*> batch;
+        for (; first != last; ++first)
+            batch.push_back(createFrom(*first));
+        if (batch.empty())
+            return;
+        std::stable_sort(batch.begin(), batch.end(), [this](const Node* a, const Node* b) {
+            return less(a->key(), b->key());
+        });
+        Guard guard(*domain_);
+        Node* preds[MaxLevel + 1];
+        Node* succs[MaxLevel + 1];
+        findNode(batch.front()->key(), preds, succs, guard);
+        int stale = insert(batch.front(), preds, succs, guard);
+        for (size_t i = 1; i < batch.size(); ++i) {
+            findNodeFrom(batch[i]->key(), preds, succs, guard, stale);
+            stale = insert(batch[i], preds, succs, guard);
+        }
+    }
+
+    // Pop minimum item (multiple consumers). Walks past the marked prefix
+    // of level 0 and marks the first live node; physical unlinking is left
+    // to pushes passing by and to the periodic head sweep.
+    bool pop(T& out) noexcept {
+        Guard guard(*domain_);
+        while (true) {
+            Node* first = guard.protect(head_->next[0], 0);
+            Node* curr = first;
+            size_t cs = 0;
+            size_t skipped = 0;
+            while (skipMarked(first, curr, cs, skipped, guard)) {
+                if (curr == tail_) {
+                    if (skipped >= boundOffset_)
+                        sweepHead(guard);
+                    return false;
+                }
+                if (!curr->fullyLinked.load(std::memory_order_acquire))
+                    break;
+                if (mark(curr)) {
+                    // curr stays protected, so it cannot be freed while we
+                    // read it even if it is swept meanwhile
+                    take(curr, out);
+                    count_.fetch_sub(1, std::memory_order_relaxed);
+                    if (skipped >= boundOffset_)
+                        sweepHead(guard);
+                    return true;
+                }
+                // Lost the race: curr is part of the frozen run now, so
+                // keep walking from it
+            }
+        }
+    }
+
+    // Pop up to max of the smallest items into out, in order (multiple
+    // consumers). Claims consecutive live nodes of level 0 in one walk from
+    // the head; they join the marked prefix and are unlinked together by
+    // the next head sweep. Returns the number of items popped.
+    size_t pop_bulk(T* out, size_t max) noexcept {
+        if (max == 0)
+            return 0;
+        Guard guard(*domain_);
+        size_t n = 0;
+        size_t prefix = 0;
+        bool drained = false;
+        while (n < max && !drained) {
+            Node* first = guard.protect(head_->next[0], 0);
+            Node* curr = first;
+            size_t cs = 0;
+            size_t skipped = 0;
+            while (skipMarked(first, curr, cs, skipped, guard)) {
+                if (curr == tail_) {
+                    drained = true;
+                    break;
+                }
+                if (!curr->fullyLinked.load(std::memory_order_acquire))
+                    break;
+                // Marked by us or by a competitor, curr is frozen either way
+                // and the walk carries on past it
+                if (mark(curr)) {
+                    take(curr, out[n++]);
+                    if (n == max)
+                        break;
+                }
+            }
+            // The walk steps over the nodes it marked itself as well, so
+            // skipped is the marked prefix it saw, as in pop
+            prefix = std::max(prefix, skipped);
+        }
+        if (n)
+            count_.fetch_sub(n, std::memory_order_relaxed);
+        if (prefix >= boundOffset_)
+            sweepHead(guard);
+        return n;
+    }
+
+    // Read the minimum key without removing it (approximate under
+    // concurrency). The minimum's payload may be moved out at any moment, so
+    // a key/value queue only reports the key.
+    bool peek(Key& out) noexcept {
+        Guard guard(*domain_);
+        while (true) {
+            Node* first = guard.protect(head_->next[0], 0);
+            Node* curr = first;
+            size_t cs = 0;
+            size_t skipped = 0;
+            if (!skipMarked(first, curr, cs, skipped, guard))
+                continue;
+            if (curr == tail_)
+                return false;
+            out = curr->key();
+            return true;
+        }
+    }
+
+    // Relaxed pop (multiple consumers): take a node near the front, within
+    // spray.rankBound() of the minimum in expectation, so that concurrent
+    // consumers spread over the first nodes instead of all contending on
+    // one. Falls back to pop when sprays run off the end or keep colliding.
+    bool pop_relaxed(T& out, const Spray& spray) noexcept {
+        {
+            Guard guard(*domain_);
+            for (int attempt = 0; attempt < SprayAttempts; ++attempt) {
+                size_t skipped = 0;
+                Node* node = sprayWalk(spray, guard, skipped);
+                bool taken = node && node != tail_ &&
+                             node->fullyLinked.load(std::memory_order_acquire) &&
+                             mark(node);
+                if (taken) {
+                    take(node, out);
+                    count_.fetch_sub(1, std::memory_order_relaxed);
+                }
+                if (skipped >= boundOffset_)
+                    sweepHead(guard);
+                if (taken)
+                    return true;
+                if (node == tail_)
+                    break;
+            }
+        }
+        return pop(out);
+    }
+
+    // Check if empty (approximate under concurrency)
+    bool empty() const noexcept {
+        return count_.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Approximate size
+    size_t size() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // Counters collected since construction (approximate under concurrency)
+    struct Stats {
+        size_t allocationsAvoided;  // push retries that reused their node
+    };
+
+    Stats stats() const noexcept {
+        Stats s;
+        s.allocationsAvoided = allocationsAvoided_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Live nodes by tower height, entry i counting nodes on levels 0..i.
+    // A balanced list has about size() * (1 - p) * p^i at height i for
+    // p = 1/2^LevelShift. Walks level 0, so it is O(n) and a snapshot
+    // under concurrent use.
+    std::vector<size_t> levelHistogram() {
+        Guard guard(*domain_);
+        std::vector<size_t> heights(MaxLevel + 1);
+        auto count = [&heights](const Node* n) {
+            ++heights[n->topLevel];
+            return true;
+        };
+        for (;;) {
+            std::fill(heights.begin(), heights.end(), 0);
+            Node* pred = head_;
+            size_t ps = predSlot(0);
+            size_t cs = 0;
+            size_t skipped = 0;
+            Node* curr = guard.protect(head_->next[0], cs);
+            if (walkLevel(count, 0, guard, pred, ps, curr, cs, skipped))
+                return heights;
+        }
+    }
+};
+
+// Thread-local RNG initialization, run lazily by every thread that draws
+template<typename T, typename Reclaimer, typename Compare, int LevelCap, int LevelShift>
+thread_local detail::XorShift64Star LockFreePQ<T, Reclaimer, Compare, LevelCap, LevelShift>::rng_(
+    detail::threadSeed());
+
+// Queue of values ordered by a separate compact key
+template<typename Key, typename Value, typename Reclaimer = HazardDomain,
+         typename Compare = std::less<Key>>
+using KeyValuePQ = LockFreePQ<KeyValue<Key, Value>, Reclaimer, Compare>;
+
+namespace detail {
+
+// Whether std::atomic<T> exists and never falls back to a lock
+template<typename T>
+struct LockFreeAtomic : std::integral_constant<bool, std::atomic<T>::is_always_lock_free> {};
+
+// Cached value together with whether it is known at all
+template<typename T>
+struct CachedEntry {
+    T value;
+    bool known;
+};
+
+// Lock-free copy of a value that readers use as a hint, unknown until the
+// first store or lower and again after reset. Types that std::atomic cannot
+// hold without a lock, along with the known flag, are not cached: load()
+// fails and callers re-read the source instead.
+template<typename T, typename = void>
+class CachedValue {
+public:
+    void store(const T&) noexcept {}
+    template<typename Compare>
+    void lower(const T&, const Compare&) noexcept {}
+    void reset() noexcept {}
+    bool load(T&) const noexcept { return false; }
+};
+
+template<typename T>
+class CachedValue<T, typename std::enable_if<
+    std::conjunction<std::is_trivially_copyable<T>,
+                     LockFreeAtomic<CachedEntry<T>>>::value>::type> {
+public:
+    CachedValue() : entry_(CachedEntry<T>{T(), false}) {}
+
+    void store(const T& v) noexcept {
+        entry_.store(CachedEntry<T>{v, true}, std::memory_order_relaxed);
+    }
+
+    // Replace the cached value if it is unknown or v orders before it
+    template<typename Compare>
+    void lower(const T& v, const Compare& less) noexcept {
+        CachedEntry<T> cur = entry_.load(std::memory_order_relaxed);
+        while ((!cur.known || less(v, cur.value)) &&
+               !entry_.compare_exchange_weak(cur, CachedEntry<T>{v, true},
+                                             std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() noexcept {
+        entry_.store(CachedEntry<T>{T(), false}, std::memory_order_relaxed);
+    }
+
+    // The cached value, or false if it is unknown
+    bool load(T& out) const noexcept {
+        CachedEntry<T> cur = entry_.load(std::memory_order_relaxed);
+        out = cur.value;
+        return cur.known;
+    }
+
+private:
+    std::atomic<CachedEntry<T>> entry_;
+};
+
+} // namespace detail
+
+// -----------------------------------------------------------------------------
+// MultiQueue: Relaxed Priority Queue over Sharded LockFreePQs
+// -----------------------------------------------------------------------------
+// Rihani, Sanders and Dementiev's MultiQueue: c * p independent LockFreePQ
+// shards for p threads. A push goes to a random shard; a pop picks two random
+// shards and takes from the one whose cached minimum is smaller. Pops return
+// one of the O(c * p) smallest items with high probability, and threads
+// rarely meet on the same shard. The cached minima are hints that may lag
+// behind concurrent operations.
+template<typename T, typename Reclaimer = HazardDomain, typename Compare = std::less<T>>
+class MultiQueue : private detail::CompareHolder<Compare> {
+public:
+    static const size_t DefaultShardsPerThread = 2;
+
+    explicit MultiQueue(size_t threads = std::thread::hardware_concurrency(),
+                        size_t shardsPerThread = DefaultShardsPerThread,
+                        Reclaimer* domain = nullptr,
+                        const Compare& compare = Compare())
+        : detail::CompareHolder<Compare>(compare)
+    {
+        size_t n = std::max<size_t>(std::max<size_t>(threads, 1) * shardsPerThread, 2);
+        shards_.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+            shards_.emplace_back(new Shard(domain, compare));
+    }
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    // Push an item into a random shard (multiple producers)
+    void push(const T& item) {
+        Shard& shard = randomShard();
+        shard.pq.push(item);
+        shard.min.lower(item, this->compare());
+    }
+
+    // The hint is lowered before the item goes in, so it can be moved; a pop
+    // that finds the shard empty meanwhile only resets the hint
+    void push(T&& item) {
+        Shard& shard = randomShard();
+        shard.min.lower(item, this->compare());
+        shard.pq.push(std::move(item));
+    }
+
+    // Pop a small item: the smaller minimum of two random shards (multiple
+    // consumers). Falls back to a scan of every shard when the random picks
+    // keep finding them empty, so false means the queue was empty.
+    bool pop(T& out) {
+        for (size_t attempt = 0; attempt < PopAttempts; ++attempt) {
+            Shard* shard = smaller(randomShard(), randomShard());
+            if (shard && take(*shard, out))
+                return true;
+        }
+        size_t start = randomIndex();
+        for (size_t i = 0; i < shards_.size(); ++i)
+            if (take(*shards_[(start + i) % shards_.size()], out))
+                return true;
+        return false;
+    }
+
+    // Check if empty (approximate under concurrency)
+    bool empty() const noexcept {
+        for (const auto& shard : shards_)
+            if (!shard->pq.empty())
+                return false;
+        return true;
+    }
+
+    // Approximate size
+    size_t size() const noexcept {
+        size_t n = 0;
+        for (const auto& shard : shards_)
+            n += shard->pq.size();
+        return n;
+    }
+
+    size_t shards() const noexcept {
+        return shards_.size();
+    }
+
+private:
+    // Two-choice pops tried before scanning every shard
+    static const size_t PopAttempts = 4;
+
+    struct alignas(64) Shard {
+        LockFreePQ<T, Reclaimer, Compare> pq;
+        detail::CachedValue<T> min;
 
-    struct Retired {
-        void* ptr;
-        std::function<void(void*)> deleter;
+        Shard(Reclaimer* domain, const Compare& compare)
+            : pq(domain, LockFreePQ<T, Reclaimer, Compare>::DefaultBoundOffset, compare) {}
     };
 
-    std::vector<Retired> retired_;
-    std::mutex mtx_;
+    std::vector<std::unique_ptr<Shard>> shards_;
 
-    HazardDomain() {
-        for (size_t i = 0; i < MAX_HAZARD_POINTERS; ++i)
-            hp_[i].store(nullptr, std::memory_order_relaxed);
+    static std::mt19937_64& rng() {
+        static thread_local std::mt19937_64 gen(std::random_device{}());
+        return gen;
     }
 
-public:
-    // Get singleton instance
-    static HazardDomain* instance() {
-        static HazardDomain inst;
-        return &inst;
+    size_t randomIndex() {
+        return std::uniform_int_distribution<size_t>(0, shards_.size() - 1)(rng());
     }
 
-    // Protect a pointer in a hazard slot (retry until stable)
-    template<typename U>
-    U* protect(std::atomic<U*>& addr, size_t idx) {
-        U* p;
-        do {
-            p = addr.load(std::memory_order_acquire);
-            hp_[idx].store(p, std::memory_order_release);
-        } while (p != addr.load(std::memory_order_acquire));
-        return p;
-    }
-
-    // Retire an object with a custom deleter, recycle when safe
-    void retire(void* ptr, std::function<void(void*)> deleter) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        retired_.push_back({ptr, deleter});
-        if (retired_.size() > MAX_HAZARD_POINTERS) scan();
-    }
-
-    // Scan hazard pointers and reclaim safe-to-delete nodes
-    void scan() {
-        std::vector<void*> hazards;
-        hazards.reserve(MAX_HAZARD_POINTERS);
-        for (size_t i = 0; i < MAX_HAZARD_POINTERS; ++i) {
-            void* p = hp_[i].load(std::memory_order_acquire);
-            if (p) hazards.push_back(p);
-        }
-        auto it = retired_.begin();
-        while (it != retired_.end()) {
-            if (std::find(hazards.begin(), hazards.end(), it->ptr) == hazards.end()) {
-                it->deleter(it->ptr);
-                it = retired_.erase(it);
-            } else {
-                ++it;
-            }
+    Shard& randomShard() {
+        return *shards_[randomIndex()];
+    }
+
+    // Minimum of a shard: the cached hint, or a peek if T is not cached or
+    // the hint is unknown
+    static bool minOf(Shard& shard, T& out) {
+        if (shard.pq.empty())
+            return false;
+        return shard.min.load(out) || shard.pq.peek(out);
+    }
+
+    // The non-empty shard with the smaller minimum, or nullptr
+    Shard* smaller(Shard& a, Shard& b) const {
+        T va, vb;
+        bool ha = minOf(a, va);
+        bool hb = minOf(b, vb);
+        if (!ha)
+            return hb ? &b : nullptr;
+        if (!hb)
+            return &a;
+        return this->compare()(vb, va) ? &b : &a;
+    }
+
+    // Pop from shard and refresh its cached minimum, which becomes unknown
+    // once the shard is found empty
+    static bool take(Shard& shard, T& out) {
+        if (!shard.pq.pop(out)) {
+            shard.min.reset();
+            return false;
         }
+        T next;
+        if (shard.pq.peek(next))
+            shard.min.store(next);
+        else
+            shard.min.reset();
+        return true;
     }
 };
 
+
 // -----------------------------------------------------------------------------
-// Lock-Free Concurrent Min-Priority Queue
+// k-LSM: Relaxed Priority Queue with Thread-Local Log-Structured Merging
 // -----------------------------------------------------------------------------
-template<typename T>
-class LockFreePQ {
+// After Wimmer et al. Every thread keeps its inserts in a private LSM: sorted
+// blocks of at most 2^i items on level i, merged like a binary counter as
+// items arrive. Once a thread holds more than k items, its largest block
+// moves to a shared LockFreePQ. A pop takes the smaller of the caller's local
+// minimum and the shared minimum, and spies on other threads' blocks when
+// both are empty, so each pop returns one of the k * p smallest items while
+// most pushes never touch shared memory.
+//
+// Items in a block are claimed through a per-slot flag, by owners and spies
+// alike. Merging claims every item it copies, so no item is taken twice, and
+// replaced blocks are retired through Reclaimer because spies may still be
+// reading them.
+template<typename T, typename Reclaimer = HazardDomain>
+class KLsmPQ {
+public:
+    static const size_t DefaultRelaxation = 256;
+
+    explicit KLsmPQ(size_t relaxation = DefaultRelaxation, Reclaimer* domain = nullptr)
+        : relaxation_(std::max<size_t>(relaxation, 1)),
+          domain_(domain ? domain : Reclaimer::instance()),
+          shared_(domain_),
+          locals_(nullptr),
+          id_(nextId())
+    {}
+
+    ~KLsmPQ() {
+        Local* local = locals_.load(std::memory_order_relaxed);
+        while (local) {
+            for (size_t i = 0; i < BlockLevels; ++i)
+                if (Block* b = local->levels[i].load(std::memory_order_relaxed))
+                    freeBlock(b);
+            Local* next = local->next;
+            delete local;
+            local = next;
+        }
+    }
+
+    KLsmPQ(const KLsmPQ&) = delete;
+    KLsmPQ& operator=(const KLsmPQ&) = delete;
+
+    // Push an item into the caller's local LSM (multiple producers)
+    void push(const T& item) {
+        Local* local = localFor(true);
+        Guard guard(*domain_);
+        // Count first: a spy may take the item as soon as it is published
+        local->count.fetch_add(1, std::memory_order_relaxed);
+        Block* carry = allocBlock(1);
+        append(carry, item);
+        size_t level = 0;
+        while (Block* b = local->levels[level].load(std::memory_order_relaxed)) {
+            Block* merged = merge(b, carry);
+            freeBlock(carry);
+            carry = merged;
+            local->levels[level].store(nullptr, std::memory_order_release);
+            guard.retire(b, &reclaimBlock);
+            ++level;
+        }
+        local->levels[level].store(carry, std::memory_order_release);
+        while (local->count.load(std::memory_order_relaxed) > relaxation_)
+            flushLargest(*local, guard);
+    }
+
+    void push(T&& item) {
+        push(item);
+    }
+
+    // Pop one of the k * p smallest items (multiple consumers)
+    bool pop(T& out) {
+        Local* local = localFor(false);
+        while (true) {
+            {
+                Guard guard(*domain_);
+                Block* b;
+                size_t i;
+                if (local && minSlot(*local, guard, b, i)) {
+                    T shared;
+                    if (!shared_.peek(shared) || !(shared < b->slot(i).value)) {
+                        if (!take(b, i))
+                            continue;
+                        out = b->slot(i).value;
+                        local->count.fetch_sub(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+            }
+            if (shared_.pop(out))
+                return true;
+            Guard guard(*domain_);
+            return spy(out, guard);
+        }
+    }
+
+    // Check if empty (approximate under concurrency)
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    // Approximate size
+    size_t size() const noexcept {
+        size_t n = shared_.size();
+        for (Local* l = locals_.load(std::memory_order_acquire); l; l = l->next)
+            n += l->count.load(std::memory_order_relaxed);
+        return n;
+    }
+
 private:
-    // Maximum levels for skiplist
-    static const int MaxLevel = 16;
-    static constexpr double Probability = 0.5;
+    using Guard = typename Reclaimer::Guard;
 
-    struct Node {
+    // Local levels; with at most k items per thread the top is never reached
+    static const size_t BlockLevels = 48;
+
+    struct Slot {
+        std::atomic<bool> taken;
         T value;
-        int topLevel;
-        std::atomic<Node*> next[MaxLevel + 1];
-        std::atomic<bool> marked;
-        std::atomic<bool> fullyLinked;
 
-        // Sentinel constructor
-        Node(int level)
-            : value(), topLevel(level), marked(false), fullyLinked(false)
-        {
-            for (int i = 0; i <= level; ++i)
-                next[i].store(nullptr, std::memory_order_relaxed);
+        explicit Slot(const T& v) : taken(false), value(v) {}
+    };
+
+    // Sorted run of items, allocated with room for its capacity. Slots are
+    // constructed in place as the block is filled.
+    struct Block : Reclaimer::Header {
+        size_t count;
+        // Every slot below this index is taken (a hint, never too high)
+        std::atomic<size_t> first;
+        alignas(Slot) unsigned char storage[sizeof(Slot)];
+
+        Block() : count(0), first(0) {}
+
+        Slot& slot(size_t i) noexcept {
+            return reinterpret_cast<Slot*>(storage)[i];
+        }
+        const Slot& slot(size_t i) const noexcept {
+            return reinterpret_cast<const Slot*>(storage)[i];
         }
 
-        // Value node constructor
-        Node(const T& val, int level)
-            : value(val), topLevel(level), marked(false), fullyLinked(false)
-        {
-            for (int i = 0; i <= level; ++i)
-                next[i].store(nullptr, std::memory_order_relaxed);
+        static size_t sizeFor(size_t capacity) noexcept {
+            return sizeof(Block) + (std::max<size_t>(capacity, 1) - 1) * sizeof(Slot);
         }
     };
 
-    // Head and tail sentinels
-    Node* head_;
-    Node* tail_;
-    std::atomic<size_t> count_;
-    HazardDomain* domain_;
+    // One thread's LSM, written only by its owner
+    struct alignas(64) Local {
+        std::atomic<Block*> levels[BlockLevels];
+        // Items published in levels and not yet taken
+        std::atomic<size_t> count;
+        std::thread::id owner;
+        Local* next;
+
+        explicit Local(std::thread::id id) : count(0), owner(id), next(nullptr) {
+            for (size_t i = 0; i < BlockLevels; ++i)
+                levels[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
 
-    // Random number generator for levels
-    static thread_local std::mt19937_64 rng_;
-    std::uniform_real_distribution<double> dist_{0.0, 1.0};
+    size_t relaxation_;
+    Reclaimer* domain_;
+    LockFreePQ<T, Reclaimer> shared_;
+    std::atomic<Local*> locals_;
+    // Distinguishes queues in the thread-local lookup cache
+    std::uint64_t id_;
 
-    // Generate random level
-    int randomLevel() {
-        int lvl = 0;
-        while (dist_(rng_) < Probability && lvl < MaxLevel)
-            ++lvl;
-        return lvl;
+    static std::uint64_t nextId() noexcept {
+        static std::atomic<std::uint64_t> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
     }
 
-    // Find preds and succs for a given key
-    bool findNode(const T& key, Node* preds[], Node* succs[]) {
-        bool found = false;
-        Node* pred = head_;
-        for (int level = MaxLevel; level >= 0; --level) {
-            Node* curr = pred->next[level].load(std::memory_order_acquire);
-            while (true) {
-                Node* succ = curr->next[level].load(std::memory_order_acquire);
-                // Skip over marked nodes
-                while (curr->marked.load(std::memory_order_acquire)) {
-                    if (!pred->next[level].compare_exchange_strong(
-                            curr, succ,
-                            std::memory_order_acq_rel)) {
-                        curr = pred->next[level].load(std::memory_order_acquire);
-                        continue;
-                    }
-                    curr = succ;
-                    succ = curr->next[level].load(std::memory_order_acquire);
-                }
-                if (curr == tail_ || curr->value < key) {
-                    pred = curr;
-                    curr = succ;
-                } else {
-                    break;
+    Block* allocBlock(size_t capacity) {
+        void* mem = ::operator new(Block::sizeFor(capacity), std::align_val_t(alignof(Block)));
+        Block* b = new (mem) Block();
+        domain_->stamp(b);
+        return b;
+    }
+
+    static void freeBlock(Block* b) noexcept {
+        for (size_t i = 0; i < b->count; ++i)
+            b->slot(i).~Slot();
+        b->~Block();
+        ::operator delete(b, std::align_val_t(alignof(Block)));
+    }
+
+    static void reclaimBlock(Reclaimable* r) {
+        freeBlock(static_cast<Block*>(r));
+    }
+
+    static void append(Block* b, const T& v) {
+        new (&b->slot(b->count)) Slot(v);
+        ++b->count;
+    }
+
+    // Claim slot i of b; only one thread ever succeeds
+    static bool take(Block* b, size_t i) noexcept {
+        bool expected = false;
+        if (!b->slot(i).taken.compare_exchange_strong(
+                expected, true, std::memory_order_acq_rel))
+            return false;
+        b->first.store(i + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    static size_t firstUntaken(const Block* b) noexcept {
+        size_t i = b->first.load(std::memory_order_relaxed);
+        while (i < b->count && b->slot(i).taken.load(std::memory_order_acquire))
+            ++i;
+        return i;
+    }
+
+    // Merge the items of the published block b that the owner manages to
+    // claim with the private block carry into a new block
+    Block* merge(Block* b, Block* carry) {
+        Block* out = allocBlock(b->count + carry->count);
+        size_t i = firstUntaken(b);
+        size_t j = 0;
+        while (i < b->count || j < carry->count) {
+            if (i < b->count &&
+                (j == carry->count || !(carry->slot(j).value < b->slot(i).value))) {
+                if (take(b, i))
+                    append(out, b->slot(i).value);
+                ++i;
+            } else {
+                append(out, carry->slot(j).value);
+                ++j;
+            }
+        }
+        return out;
+    }
+
+    // Move the owner's largest block into the shared component
+    void flushLargest(Local& local, Guard& guard) {
+        size_t level = BlockLevels;
+        while (level-- > 0) {
+            Block* b = local.levels[level].load(std::memory_order_relaxed);
+            if (!b)
+                continue;
+            local.levels[level].store(nullptr, std::memory_order_release);
+            size_t moved = 0;
+            for (size_t i = firstUntaken(b); i < b->count; ++i) {
+                if (take(b, i)) {
+                    shared_.push(b->slot(i).value);
+                    ++moved;
                 }
             }
-            preds[level] = pred;
-            succs[level] = curr;
+            // Counted in shared_ before leaving the local count, so size()
+            // never misses them
+            local.count.fetch_sub(moved, std::memory_order_relaxed);
+            guard.retire(b, &reclaimBlock);
+            return;
         }
-        if (succs[0] != tail_ && succs[0]->value == key)
-            found = true;
-        return found;
     }
 
-public:
-    // Construct priority queue
-    LockFreePQ(HazardDomain* domain = nullptr)
-        : count_(0)
-    {
-        domain_ = domain ? domain : HazardDomain::instance();
-        head_ = new Node(MaxLevel);
-        tail_ = new Node(MaxLevel);
-        for (int i = 0; i <= MaxLevel; ++i)
-            head_->next[i].store(tail_, std::memory_order_relaxed);
-        // Seed RNG per thread
-        std::random_device rd;
-        rng_.seed(rd());
+    // Find the smallest untaken slot of local, leaving its block protected
+    // in slot 0 or 1 of guard
+    static bool minSlot(Local& local, Guard& guard, Block*& best, size_t& bestIdx) {
+        best = nullptr;
+        size_t bestSlot = 0;
+        for (size_t level = 0; level < BlockLevels; ++level) {
+            size_t slot = best ? 1 - bestSlot : 0;
+            Block* b = guard.protect(local.levels[level], slot);
+            if (!b)
+                continue;
+            size_t i = firstUntaken(b);
+            if (i == b->count)
+                continue;
+            if (!best || b->slot(i).value < best->slot(bestIdx).value) {
+                best = b;
+                bestIdx = i;
+                bestSlot = slot;
+            }
+        }
+        return best != nullptr;
     }
 
-    ~LockFreePQ() {
-        // Delete all nodes
-        Node* node = head_;
-        while (node) {
-            Node* next = node->next[0].load(std::memory_order_relaxed);
-            delete node;
-            node = (next == tail_) ? nullptr : next;
+    // Take the minimum of the first thread that still holds local items
+    bool spy(T& out, Guard& guard) {
+        for (Local* l = locals_.load(std::memory_order_acquire); l; l = l->next) {
+            Block* b;
+            size_t i;
+            while (minSlot(*l, guard, b, i)) {
+                if (take(b, i)) {
+                    out = b->slot(i).value;
+                    l->count.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
         }
-        delete tail_;
+        return false;
     }
 
-    // Disable copy
-    LockFreePQ(const LockFreePQ&) = delete;
-    LockFreePQ& operator=(const LockFreePQ&) = delete;
+    // The caller's LSM for this queue, registered on first use if create
+    Local* localFor(bool create) {
+        struct Cache {
+            std::uint64_t id;
+            Local* local;
+        };
+        static thread_local Cache cache = {0, nullptr};
+        if (cache.id == id_ && (cache.local || !create))
+            return cache.local;
+        std::thread::id me = std::this_thread::get_id();
+        Local* local = locals_.load(std::memory_order_acquire);
+        while (local && local->owner != me)
+            local = local->next;
+        if (!local) {
+            if (!create) {
+                cache = {id_, nullptr};
+                return nullptr;
+            }
+            local = new Local(me);
+            Local* head = locals_.load(std::memory_order_relaxed);
+            do {
+                local->next = head;
+            } while (!locals_.compare_exchange_weak(
+                         head, local,
+                         std::memory_order_release,
+                         std::memory_order_relaxed));
+        }
+        cache = {id_, local};
+        return local;
+    }
+};
 
-    // Push an item (multiple producers)
-    void push(const T& item) noexcept {
-        Node* preds[MaxLevel + 1];
-        Node* succs[MaxLevel + 1];
-        int topLevel = randomLevel();
-        while (true) {
-            findNode(item, preds, succs);
-            Node* newNode = new Node(item, topLevel);
-            for (int lvl = 0; lvl <= topLevel; ++lvl)
-                newNode->next[lvl].store(succs[lvl], std::memory_order_relaxed);
-            Node* pred = preds[0];
-            Node* succ = succs[0];
-            if (!pred->next[0].compare_exchange_strong(
-                    succ, newNode,
-                    std::memory_order_acq_rel)) {
-                delete newNode;
-                continue;
+// -----------------------------------------------------------------------------
+// Bucketed Priority Queue for Small Integer Keys
+// -----------------------------------------------------------------------------
+// For keys in [0, Priorities): one lock-free FIFO bucket per priority and an
+// occupancy bitmap, so a push is an enqueue plus at most one fetch_or and a
+// pop finds the smallest non-empty bucket with ctz over Priorities / 64
+// words; no skiplist traversal at all. It has LockFreePQ's push, emplace,
+// push_bulk, pop, pop_bulk, peek, empty and size, with the same ordering:
+// smallest key first, FIFO among equal keys.
+//
+// A plain integer T keeps only a count per priority. For T = KeyValue<K, V>
+// each bucket is a Michael-Scott queue of values, whose nodes are retired
+// through Reclaimer. A bucket's bit is set after every push into it and is
+// cleared by a pop that finds it empty, which re-sets it if the bucket has
+// refilled meanwhile, so an item is never left behind a clear bit.
+template<typename T, typename Reclaimer = HazardDomain, size_t Priorities = 256>
+class BucketPQ {
+private:
+    using Key = typename detail::EntryTraits<T>::Key;
+    using Payload = typename detail::EntryTraits<T>::Payload;
+    static const bool HasPayload = detail::EntryTraits<T>::HasPayload;
+
+    static_assert(std::is_integral<Key>::value, "BucketPQ keys must be integers");
+    static_assert(Priorities > 0, "BucketPQ needs at least one priority");
+
+    static const size_t Words = (Priorities + 63) / 64;
+
+public:
+    explicit BucketPQ(Reclaimer* domain = nullptr)
+        : domain_(domain ? domain : Reclaimer::instance()), count_(0)
+    {
+        for (size_t w = 0; w < Words; ++w)
+            occupied_[w].store(0, std::memory_order_relaxed);
+        if constexpr (HasPayload) {
+            for (size_t p = 0; p < Priorities; ++p) {
+                Node* dummy = allocNode();
+                buckets_[p].head.store(dummy, std::memory_order_relaxed);
+                buckets_[p].tail.store(dummy, std::memory_order_relaxed);
             }
-            for (int lvl = 1; lvl <= topLevel; ++lvl) {
-                while (!preds[lvl]->next[lvl].compare_exchange_strong(
-                        succs[lvl], newNode,
-                        std::memory_order_acq_rel)) {
-                    findNode(item, preds, succs);
+        }
+    }
+
+    ~BucketPQ() {
+        if constexpr (HasPayload) {
+            for (size_t p = 0; p < Priorities; ++p) {
+                // Every node past the dummy still holds its payload
+                Node* node = buckets_[p].head.load(std::memory_order_relaxed);
+                Node* next = node->next.load(std::memory_order_relaxed);
+                freeNode(node);
+                for (node = next; node; node = next) {
+                    next = node->next.load(std::memory_order_relaxed);
+                    node->payload().~Payload();
+                    freeNode(node);
                 }
             }
-            newNode->fullyLinked.store(true, std::memory_order_release);
-            count_.fetch_add(1, std::memory_order_relaxed);
-            break;
         }
     }
 
-    void push(T&& item) noexcept {
-        push(item);
+    BucketPQ(const BucketPQ&) = delete;
+    BucketPQ& operator=(const BucketPQ&) = delete;
+
+    // Push an item (multiple producers); its key must be in [0, Priorities)
+    void push(const T& item) {
+        if constexpr (HasPayload)
+            emplace(item.key, item.value);
+        else
+            emplace(item);
     }
 
-    // Pop minimum item (multiple consumers)
-    bool pop(T& out) noexcept {
-        Node* node = nullptr;
-        while (true) {
-            node = head_->next[0].load(std::memory_order_acquire);
-            if (node == tail_)
-                return false;
-            if (!node->fullyLinked.load(std::memory_order_acquire))
-                continue;
-            bool expected = false;
-            if (node->marked.compare_exchange_strong(
-                    expected, true,
-                    std::memory_order_acq_rel)) {
-                out = node->value;
-                Node* preds[MaxLevel + 1];
-                Node* succs[MaxLevel + 1];
-                findNode(node->value, preds, succs);
-                for (int lvl = node->topLevel; lvl >= 0; --lvl) {
-                    preds[lvl]->next[lvl].compare_exchange_strong(
-                        node, node->next[lvl].load(std::memory_order_acquire),
-                        std::memory_order_acq_rel);
+    void push(T&& item) {
+        if constexpr (HasPayload)
+            emplace(item.key, std::move(item.value));
+        else
+            emplace(item);
+    }
+
+    // Push an item constructed from args (multiple producers). For a
+    // key/value queue, args are the key and the value's constructor
+    // arguments.
+    template<typename K, typename... Args>
+    void emplace(K&& key, Args&&... args) {
+        size_t p;
+        if constexpr (HasPayload) {
+            p = static_cast<size_t>(key);
+            enqueue(buckets_[p], std::forward<Args>(args)...);
+        } else {
+            p = static_cast<size_t>(Key(std::forward<K>(key), std::forward<Args>(args)...));
+            // Seq-cst so that a pop clearing the bit after the load below
+            // sees the count when it re-checks the bucket
+            buckets_[p].value.fetch_add(1);
+        }
+        count_.fetch_add(1, std::memory_order_relaxed);
+        std::uint64_t bit = std::uint64_t(1) << (p % 64);
+        if (!(occupied_[p / 64].load() & bit))
+            occupied_[p / 64].fetch_or(bit);
+    }
+
+    // Push a batch (multiple producers)
+    template<typename InputIt>
+    void push_bulk(InputIt first, InputIt last) {
+        for (; first != last; ++first)
+            push(*first);
+    }
+
+    // Pop an item with the smallest key (multiple consumers)
+    bool pop(T& out) {
+        Guard guard(*domain_);
+        return take(out, guard);
+    }
+
+    // Pop up to max of the smallest items into out, in order (multiple
+    // consumers). Returns the number of items popped.
+    size_t pop_bulk(T* out, size_t max) {
+        Guard guard(*domain_);
+        size_t n = 0;
+        while (n < max && take(out[n], guard))
+            ++n;
+        return n;
+    }
+
+    // Read the smallest key without removing it (approximate under
+    // concurrency)
+    bool peek(Key& out) {
+        Guard guard(*domain_);
+        for (size_t w = 0; w < Words; ++w) {
+            std::uint64_t bits = occupied_[w].load(std::memory_order_acquire);
+            for (; bits; bits &= bits - 1) {
+                size_t p = w * 64 + detail::ctz64(bits);
+                if (!isEmpty(p, guard)) {
+                    out = static_cast<Key>(p);
+                    return true;
                 }
-                domain_->retire(node, [](void* p) {
-                    delete static_cast<Node*>(p);
-                });
-                count_.fetch_sub(1, std::memory_order_relaxed);
-                return true;
             }
         }
+        return false;
     }
 
     // Check if empty (approximate under concurrency)
@@ -267,10 +2605,177 @@ public:
     size_t size() const noexcept {
         return count_.load(std::memory_order_relaxed);
     }
+
+private:
+    using Guard = typename Reclaimer::Guard;
+
+    // Bucket of a key/value queue: head is a dummy whose successors hold
+    // the payloads
+    struct Node : Reclaimer::Header {
+        std::atomic<Node*> next;
+        alignas(Payload) unsigned char storage[sizeof(Payload)];
+
+        Node() : next(nullptr) {}
+
+        Payload& payload() noexcept {
+            return *std::launder(reinterpret_cast<Payload*>(storage));
+        }
+    };
+
+    struct NodeBlock {
+        static const size_t blockAlign = std::max<size_t>(64, alignof(Node));
+        static size_t blockSize(size_t) noexcept {
+            return sizeof(Node);
+        }
+    };
+    using Pool = detail::SlabPool<NodeBlock, 1>;
+
+    struct alignas(64) Queue {
+        std::atomic<Node*> head;
+        std::atomic<Node*> tail;
+    };
+
+    struct alignas(64) Counter {
+        std::atomic<size_t> value{0};
+    };
+
+    Node* allocNode() {
+        Node* node = new (Pool::instance().allocate(0)) Node();
+        domain_->stamp(node);
+        return node;
+    }
+
+    // Nodes are freed as dummies, after their payload has been moved out
+    static void freeNode(Node* node) noexcept {
+        node->~Node();
+        Pool::instance().deallocate(node, 0);
+    }
+
+    static void reclaimNode(Reclaimable* r) {
+        freeNode(static_cast<Node*>(r));
+    }
+
+    template<typename... Args>
+    void enqueue(Queue& q, Args&&... args) {
+        Node* node = allocNode();
+        new (node->storage) Payload(std::forward<Args>(args)...);
+        Guard guard(*domain_);
+        while (true) {
+            Node* tail = guard.protect(q.tail, 0);
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if (tail != q.tail.load(std::memory_order_acquire))
+                continue;
+            if (next) {
+                q.tail.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+                continue;
+            }
+            // Seq-cst for the same reason as the counter increment in emplace
+            if (tail->next.compare_exchange_strong(next, node)) {
+                q.tail.compare_exchange_strong(tail, node, std::memory_order_acq_rel);
+                return;
+            }
+        }
+    }
+
+    // Dequeue the oldest payload of q into out. Only the thread whose CAS
+    // advances the head touches the new dummy's payload, so it is moved out.
+    bool dequeue(Queue& q, Payload& out, Guard& guard) {
+        while (true) {
+            Node* head = guard.protect(q.head, 0);
+            Node* next = guard.protect(head->next, 1);
+            if (head != q.head.load(std::memory_order_acquire))
+                continue;
+            if (!next)
+                return false;
+            Node* tail = q.tail.load(std::memory_order_acquire);
+            if (head == tail) {
+                q.tail.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+                continue;
+            }
+            if (q.head.compare_exchange_strong(head, next, std::memory_order_acq_rel)) {
+                out = std::move(next->payload());
+                next->payload().~Payload();
+                guard.retire(head, &reclaimNode);
+                return true;
+            }
+        }
+    }
+
+    bool isEmpty(size_t p, Guard& guard) {
+        if constexpr (HasPayload) {
+            Node* head = guard.protect(buckets_[p].head, 0);
+            return head->next.load() == nullptr;
+        } else {
+            (void)guard;
+            return buckets_[p].value.load() == 0;
+        }
+    }
+
+    bool takeFrom(size_t p, T& out, Guard& guard) {
+        if constexpr (HasPayload) {
+            if (!dequeue(buckets_[p], out.value, guard))
+                return false;
+            out.key = static_cast<Key>(p);
+        } else {
+            (void)guard;
+            size_t n = buckets_[p].value.load(std::memory_order_relaxed);
+            do {
+                if (n == 0)
+                    return false;
+            } while (!buckets_[p].value.compare_exchange_weak(
+                         n, n - 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+            out = static_cast<Key>(p);
+        }
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Clear the bit of bucket p, found empty; returns true if the bucket has
+    // refilled meanwhile, in which case the bit is set again
+    bool settle(size_t p, Guard& guard) {
+        std::uint64_t bit = std::uint64_t(1) << (p % 64);
+        occupied_[p / 64].fetch_and(~bit);
+        if (isEmpty(p, guard))
+            return false;
+        occupied_[p / 64].fetch_or(bit);
+        return true;
+    }
+
+    bool take(T& out, Guard& guard) {
+        for (size_t w = 0; w < Words; ++w) {
+            std::uint64_t bits = occupied_[w].load(std::memory_order_acquire);
+            while (bits) {
+                size_t p = w * 64 + detail::ctz64(bits);
+                if (takeFrom(p, out, guard))
+                    return true;
+                if (!settle(p, guard))
+                    bits &= bits - 1;
+            }
+        }
+        return false;
+    }
+
+    using Bucket = typename std::conditional<HasPayload, Queue, Counter>::type;
+
+    Reclaimer* domain_;
+    std::atomic<size_t> count_;
+    std::atomic<std::uint64_t> occupied_[Words];
+    Bucket buckets_[Priorities];
 };
 
-// Thread-local RNG initialization
-template<typename T>
-thread_local std::mt19937_64 LockFreePQ<T>::rng_;
+namespace detail {
+
+// Whether every key fits the 256 buckets of a default BucketPQ
+template<typename Key>
+struct SmallKey : std::integral_constant<bool,
+    std::is_unsigned<Key>::value && sizeof(Key) == 1 && !std::is_same<Key, bool>::value> {};
+
+} // namespace detail
+
+// LockFreePQ, or BucketPQ when keys are 8-bit unsigned integers
+template<typename T, typename Reclaimer = HazardDomain>
+using PriorityQueue = typename std::conditional<
+    detail::SmallKey<typename detail::EntryTraits<T>::Key>::value,
+    BucketPQ<T, Reclaimer>, LockFreePQ<T, Reclaimer>>::type;
 
 } // namespace lf